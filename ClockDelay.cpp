@@ -1,4 +1,5 @@
 #define SERIAL_DEBUG
+// #define EVENT_TRACE
 #ifdef SERIAL_DEBUG
 #include "serial.h"
 #endif // SERIAL_DEBUG
@@ -10,6 +11,22 @@
 #include "adc_freerunner.h"
 // #include "DiscreteController.h"
 #include "DeadbandController.h"
+#include "IsrProfiler.h"
+#include "EuclidPatterns.h"
+#include "IntervalRing.h"
+#ifdef SERIAL_DEBUG
+#include "SerialCommand.h"
+#include "PresetStore.h"
+#endif // SERIAL_DEBUG
+#ifdef EVENT_TRACE
+#include "EventTrace.h"
+#endif // EVENT_TRACE
+#ifdef LATENCY_HISTOGRAM
+#include "LatencyHistogram.h"
+#endif // LATENCY_HISTOGRAM
+#ifdef STACK_MONITOR
+#include "StackMonitor.h"
+#endif // STACK_MONITOR
 
 inline bool clockIsHigh(){
   return !(CLOCKDELAY_CLOCK_PINS & _BV(CLOCKDELAY_CLOCK_PIN));
@@ -27,50 +44,148 @@ inline bool isDelayMode(){
   return !(MODE_SWITCH_PINS & _BV(MODE_SWITCH_PIN_B));
 }
 
+/*
+  The mode switch selects divide or delay mode. The other modes have no
+  panel control yet, they are only selected over serial with M<n>, which
+  keeps the mode until L returns it to the switch.
+ */
 enum OperatingMode {
   DISABLED_MODE                   = 0,
   DIVIDE_MODE                     = 1,
-  DELAY_MODE                      = 2
+  DELAY_MODE                      = 2,
+  BURST_MODE                      = 3,
+  EUCLID_MODE                     = 4,
+  CHANCE_MODE                     = 5,
+  LOOP_MODE                       = 6,
+  RATIO_MODE                      = 7,
+  WIDE_MODE                       = 8
+};
+
+#define CHANCE_SEED                0xace1
+#define CHANCE_LEVELS              31 // of the counter value, the last always passes
+
+/*
+  Pin bindings of a channel. Ports and pins are resolved at compile time,
+  so each access is a single sbi, cbi or sbis instruction.
+ */
+struct ClockInput {
+  static inline bool isHigh(){
+    return clockIsHigh();
+  }
+};
+
+struct DivideOutput {
+  static inline bool isOff(){
+    return DIVIDE_OUTPUT_PINS & _BV(DIVIDE_OUTPUT_PIN);
+  }
+  static inline void on(){
+    DIVIDE_OUTPUT_PORT &= ~_BV(DIVIDE_OUTPUT_PIN);
+    CLOCKDELAY_LEDS_PORT |= _BV(CLOCKDELAY_LED_2_PIN);
+  }
+  static inline void off(){
+    DIVIDE_OUTPUT_PORT |= _BV(DIVIDE_OUTPUT_PIN);
+    CLOCKDELAY_LEDS_PORT &= ~_BV(CLOCKDELAY_LED_2_PIN);
+  }
+  static inline void toggle(){
+    DIVIDE_OUTPUT_PORT ^= _BV(DIVIDE_OUTPUT_PIN);
+    CLOCKDELAY_LEDS_PORT ^= _BV(CLOCKDELAY_LED_2_PIN);
+  }
+};
+
+struct DelayOutput {
+  static inline bool isOff(){
+    return DELAY_OUTPUT_PINS & _BV(DELAY_OUTPUT_PIN);
+  }
+  static inline void on(){
+    DELAY_OUTPUT_PORT &= ~_BV(DELAY_OUTPUT_PIN);
+    CLOCKDELAY_LEDS_PORT |= _BV(CLOCKDELAY_LED_3_PIN);
+  }
+  static inline void off(){
+    DELAY_OUTPUT_PORT |= _BV(DELAY_OUTPUT_PIN);
+    CLOCKDELAY_LEDS_PORT &= ~_BV(CLOCKDELAY_LED_3_PIN);
+  }
+  static inline void toggle(){
+    DELAY_OUTPUT_PORT ^= _BV(DELAY_OUTPUT_PIN);
+    CLOCKDELAY_LEDS_PORT ^= _BV(CLOCKDELAY_LED_3_PIN);
+  }
 };
 
+struct CombinedOutput {
+  static inline bool isOff(){
+    return COMBINED_OUTPUT_PINS & _BV(COMBINED_OUTPUT_PIN);
+  }
+  static inline void on(){
+    COMBINED_OUTPUT_PORT &= ~_BV(COMBINED_OUTPUT_PIN);
+    CLOCKDELAY_LEDS_PORT |= _BV(CLOCKDELAY_LED_1_PIN);
+  }
+  static inline void off(){
+    COMBINED_OUTPUT_PORT |= _BV(COMBINED_OUTPUT_PIN);
+    CLOCKDELAY_LEDS_PORT &= ~_BV(CLOCKDELAY_LED_1_PIN);
+  }
+  static inline void toggle(){
+    COMBINED_OUTPUT_PORT ^= _BV(COMBINED_OUTPUT_PIN);
+    CLOCKDELAY_LEDS_PORT ^= _BV(CLOCKDELAY_LED_1_PIN);
+  }
+};
+
+template<class Output, typename Count = uint8_t>
 class ClockCounter {
 public:
   inline void reset(){
     pos = 0;
+    gateLeft = 0;
     off();
   }
   bool next(){
-    if(++pos > value){
+    // compared before the increment, which would wrap at the largest value
+    if(pos >= value){
       pos = 0;
       return true;
     }
+    pos++;
     return false;
   }
 public:
-  uint8_t pos;
-  uint8_t value;
-  void rise(){
-    if(next())
-      on();
-    else
+  Count pos;
+  Count value;
+  uint16_t gate; // pulse width in timer ticks, 0 follows the clock
+  uint16_t gateLeft;
+  /* true if the output fires on this rise */
+  bool rise(){
+    if(next()){
+      fire();
+      return true;
+    }
+    skip();
+    return false;
+  }
+  inline void fire(){
+    on();
+    gateLeft = gate;
+  }
+  inline void skip(){
+    if(!gate)
       off();
   }
   inline void fall(){
-    off();
+    if(!gate)
+      off();
   }
-  virtual bool isOff(){
-    return DELAY_OUTPUT_PINS & _BV(DELAY_OUTPUT_PIN);
+  inline void clock(){
+    if(gateLeft && --gateLeft == 0)
+      off();
   }
-  virtual void on(){
-    DELAY_OUTPUT_PORT &= ~_BV(DELAY_OUTPUT_PIN);
-    CLOCKDELAY_LEDS_PORT |= _BV(CLOCKDELAY_LED_3_PIN);
+  inline bool isOff(){
+    return Output::isOff();
   }
-  virtual void off(){
-    DELAY_OUTPUT_PORT |= _BV(DELAY_OUTPUT_PIN);
-    CLOCKDELAY_LEDS_PORT &= ~_BV(CLOCKDELAY_LED_3_PIN);
+  inline void on(){
+    Output::on();
+  }
+  inline void off(){
+    Output::off();
   }
 #ifdef SERIAL_DEBUG
-  virtual void dump(){
+  void dump(){
     printString("pos ");
     printInteger(pos);
     printString(", value ");
@@ -83,11 +198,88 @@ public:
 #endif
 };
 
+/* Marsaglia's 16 bit xorshift, (7, 9, 8): a period of 65535, never 0 */
+class Xorshift16 {
+public:
+  uint16_t state;
+  inline uint16_t next(){
+    state ^= state << 7;
+    state ^= state >> 9;
+    state ^= state << 8;
+    return state;
+  }
+};
+
+/*
+  Division by a ratio of clocks to pulses, num/den with num >= den: den
+  pulses spread over every num clocks, the first on the first clock.
+  The remainder carries over from one clock to the next, so there is no
+  drift however long it runs.
+ */
+class RatioDivider {
+public:
+  uint8_t num;
+  uint8_t den;
+  uint8_t acc;
+  inline void reset(){
+    acc = num-den;
+  }
+  /* called from the main loop */
+  void select(uint8_t n, uint8_t d){
+    if(n == num && d == den)
+      return;
+    cli();
+    num = n;
+    den = d;
+    reset();
+    sei();
+  }
+  /* true if this clock gives a pulse */
+  inline bool next(){
+    acc += den;
+    if(acc >= num){
+      acc -= num;
+      return true;
+    }
+    return false;
+  }
+#ifdef SERIAL_DEBUG
+  void dump(){
+    printInteger(num);
+    printByte('/');
+    printInteger(den);
+    printString(", acc ");
+    printInteger(acc);
+  }
+#endif
+};
+
+#define WIDE_COUNTS                32
+/*
+  counts of the wide counter, less one, selected by the counter: powers
+  of two and three times powers of two, which include the bars and
+  phrases of a 24 PPQN clock, 96 a bar of 4/4, up to 65536
+ */
+const uint16_t wideCounts[WIDE_COUNTS] PROGMEM = {
+  0, 1, 2, 3, 5, 7, 11, 15, 23, 31, 47, 63, 95, 127, 191, 255, 383, 511,
+  767, 1023, 1535, 2047, 3071, 4095, 6143, 8191, 12287, 16383, 24575,
+  32767, 49151, 65535
+};
+
+#define RATIOS                     17
+/* clocks and pulses of the ratios selected by the divider, in increasing order */
+const uint8_t ratios[RATIOS][2] PROGMEM = {
+  {1, 1}, {5, 4}, {4, 3}, {3, 2}, {5, 3}, {7, 4}, {2, 1}, {9, 4}, {7, 3},
+  {5, 2}, {8, 3}, {3, 1}, {7, 2}, {4, 1}, {5, 1}, {6, 1}, {8, 1}
+};
+
+template<class Output>
 class ClockDivider {
 public:
   inline void reset(){
     pos = 0;
     toggled = false;
+    resume = false;
     off();
   }
   bool next(){
@@ -101,10 +293,15 @@ public:
   uint8_t pos;
   int8_t value;
   bool toggled;
+  bool resume; // set idle by quiesce(), on again from the next rise
   inline bool isOff(){
-    return DIVIDE_OUTPUT_PINS & _BV(DIVIDE_OUTPUT_PIN);
+    return Output::isOff();
   }
   void rise(){
+    if(resume){
+      resume = false;
+      on();
+    }
     if(next()){
       toggle();
       toggled = true;
@@ -114,20 +311,24 @@ public:
     if(value == -1)
       off();
   }
-  void toggle(){
-    DIVIDE_OUTPUT_PORT ^= _BV(DIVIDE_OUTPUT_PIN);
-    CLOCKDELAY_LEDS_PORT ^= _BV(CLOCKDELAY_LED_2_PIN);
+  /* idle while the clock is lost, keeping the count so the phase carries on */
+  void quiesce(){
+    if(!isOff()){
+      off();
+      resume = value != -1; // which follows the clock
+    }
   }
-  void on(){
-    DIVIDE_OUTPUT_PORT &= ~_BV(DIVIDE_OUTPUT_PIN);
-    CLOCKDELAY_LEDS_PORT |= _BV(CLOCKDELAY_LED_2_PIN);
+  inline void toggle(){
+    Output::toggle();
   }
-  void off(){
-    DIVIDE_OUTPUT_PORT |= _BV(DIVIDE_OUTPUT_PIN);
-    CLOCKDELAY_LEDS_PORT &= ~_BV(CLOCKDELAY_LED_2_PIN);
+  inline void on(){
+    Output::on();
+  }
+  inline void off(){
+    Output::off();
   }
 #ifdef SERIAL_DEBUG
-  virtual void dump(){
+  void dump(){
     printString("pos ");
     printInteger(pos);
     printString(", value ");
@@ -140,11 +341,13 @@ public:
 #endif
 };
 
+template<class Output>
 class ClockDelay {
 public:
   uint16_t riseMark;
   uint16_t fallMark;
   uint16_t value;
+  uint16_t gate; // pulse width in timer ticks, 0 follows the clock
   volatile uint16_t pos;
   volatile bool running;
   inline void start(){
@@ -162,9 +365,24 @@ public:
   inline void rise(){
     riseMark = value;
     start();
+    if(gate)
+      fallMark = riseMark > 0xffff-gate ? 0xffff : riseMark+gate;
   }
   inline void fall(){
-    fallMark = riseMark+pos;
+    if(!gate)
+      fallMark = riseMark+pos;
+  }
+  /* the clock is lost while high: a pulse waiting for its fall ends now,
+     one still to rise plays out as if the clock had fallen now */
+  void quiesce(){
+    if(running && !gate && !fallMark){
+      if(pos < riseMark){
+	fall();
+      }else{
+	off();
+	stop();
+      }
+    }
   }
   inline void clock(){
     if(running){
@@ -176,19 +394,17 @@ public:
       }
     }
   }
-  virtual void on(){
-    DELAY_OUTPUT_PORT &= ~_BV(DELAY_OUTPUT_PIN);
-    CLOCKDELAY_LEDS_PORT |= _BV(CLOCKDELAY_LED_3_PIN);
+  inline void on(){
+    Output::on();
   }
-  virtual void off(){
-    DELAY_OUTPUT_PORT |= _BV(DELAY_OUTPUT_PIN);
-    CLOCKDELAY_LEDS_PORT &= ~_BV(CLOCKDELAY_LED_3_PIN);
+  inline void off(){
+    Output::off();
   }
-  virtual bool isOff(){
-    return DELAY_OUTPUT_PINS & _BV(DELAY_OUTPUT_PIN);
+  inline bool isOff(){
+    return Output::isOff();
   }
 #ifdef SERIAL_DEBUG
-  virtual void dump(){
+  void dump(){
     printString("rise ");
     printInteger(riseMark);
     printString(", fall ");
@@ -209,99 +425,822 @@ public:
 #endif
 };
 
-class ClockSwing : public ClockDelay {
+/*
+  A burst of evenly spaced pulses, started by a clock rise. The spacing
+  and pulse width are worked out once at the rise, the timer then plays
+  the burst out with one increment and two compares per tick.
+ */
+template<class Output>
+class ClockBurst {
 public:
-  void on(){
-    COMBINED_OUTPUT_PORT &= ~_BV(COMBINED_OUTPUT_PIN);
-    CLOCKDELAY_LEDS_PORT |= _BV(CLOCKDELAY_LED_1_PIN);
+  uint16_t spacing; // timer ticks from one pulse to the next
+  uint16_t width;
+  uint16_t gate; // pulse width in timer ticks, 0 half the spacing
+  volatile uint16_t pos;
+  volatile uint8_t left; // pulses still to start
+  volatile bool running;
+  inline void reset(){
+    running = false;
+    left = 0;
+    off();
   }
- void off(){
-    COMBINED_OUTPUT_PORT |= _BV(COMBINED_OUTPUT_PIN);
-    CLOCKDELAY_LEDS_PORT &= ~_BV(CLOCKDELAY_LED_1_PIN);
+  /* 'count' pulses, the first now, the last starting within 'window' ticks */
+  void rise(uint16_t count, uint16_t window){
+    spacing = window/count;
+    if(spacing < 2)
+      spacing = 2; // room for the output to go off between pulses
+    width = gate && gate < spacing ? gate : spacing/2;
+    pos = 0;
+    left = count-1;
+    running = true;
+    on();
   }
-  bool isOff(){
-    return COMBINED_OUTPUT_PINS & _BV(COMBINED_OUTPUT_PIN);
+  inline void clock(){
+    if(!running)
+      return;
+    if(++pos == width){
+      off();
+      if(!left)
+	running = false;
+    }else if(pos == spacing){
+      pos = 0;
+      left--;
+      on();
+    }
+  }
+  inline void on(){
+    Output::on();
+  }
+  inline void off(){
+    Output::off();
+  }
+  inline bool isOff(){
+    return Output::isOff();
+  }
+#ifdef SERIAL_DEBUG
+  void dump(){
+    printString("spacing ");
+    printInteger(spacing);
+    printString(", width ");
+    printInteger(width);
+    printString(", left ");
+    printInteger(left);
+    if(running)
+      printString(" running");
+    else
+      printString(" stopped");
+    if(isOff())
+      printString(" off");
+    else
+      printString(" on");
   }
+#endif
 };
 
-class DividingCounter : public ClockCounter {
+/*
+  A Euclidean rhythm: 'hits' pulses spread as evenly as they can be over
+  'steps' clock rises. The pattern is read from the table in flash when
+  the steps or hits change, in the main loop, and taken up at the start
+  of the next cycle. Each rise is then one bit test and shift.
+ */
+template<class Output>
+class ClockEuclid {
 public:
-  void on(){
-    COMBINED_OUTPUT_PORT &= ~_BV(COMBINED_OUTPUT_PIN);
-    CLOCKDELAY_LEDS_PORT |= _BV(CLOCKDELAY_LED_1_PIN);
+  uint32_t pattern; // bit i set if step i is a hit
+  uint32_t bits; // the rest of this cycle, the next step in bit 0
+  uint8_t steps;
+  uint8_t hits;
+  uint8_t pos;
+  uint16_t gate; // pulse width in timer ticks, 0 follows the clock
+  uint16_t gateLeft;
+  inline void reset(){
+    pos = 0;
+    gateLeft = 0;
+    off();
   }
- void off(){
-    COMBINED_OUTPUT_PORT |= _BV(COMBINED_OUTPUT_PIN);
-    CLOCKDELAY_LEDS_PORT &= ~_BV(CLOCKDELAY_LED_1_PIN);
+  /* called from the main loop */
+  void select(uint8_t s, uint8_t h){
+    if(s > EUCLID_MAX_STEPS)
+      s = EUCLID_MAX_STEPS;
+    if(s == 0)
+      s = 1;
+    if(h > s)
+      h = s;
+    if(s == steps && h == hits)
+      return;
+    uint32_t p = h ? pgm_read_dword(euclidPatterns+EUCLID_INDEX(s, h)) : 0;
+    cli();
+    pattern = p;
+    steps = s;
+    hits = h;
+    sei();
   }
-  bool isOff(){
-    return COMBINED_OUTPUT_PINS & _BV(COMBINED_OUTPUT_PIN);
+  /* true if the output fires on this rise */
+  bool rise(){
+    if(pos == 0)
+      bits = pattern;
+    bool hit = bits & 1;
+    bits >>= 1;
+    if(++pos >= steps)
+      pos = 0;
+    if(hit){
+      on();
+      gateLeft = gate;
+    }else if(!gate){
+      off();
+    }
+    return hit;
+  }
+  inline void fall(){
+    if(!gate)
+      off();
+  }
+  inline void clock(){
+    if(gateLeft && --gateLeft == 0)
+      off();
+  }
+  inline bool isOff(){
+    return Output::isOff();
+  }
+  inline void on(){
+    Output::on();
   }
+  inline void off(){
+    Output::off();
+  }
+#ifdef SERIAL_DEBUG
+  void dump(){
+    printString("steps ");
+    printInteger(steps);
+    printString(", hits ");
+    printInteger(hits);
+    printString(", pos ");
+    printInteger(pos);
+    if(isOff())
+      printString(" off");
+    else
+      printString(" on");
+  }
+#endif
 };
 
-ClockCounter counter;
-ClockDivider divider;
-ClockDelay delay; // manually triggered from Timer0 interrupt
-ClockSwing swinger;
-DividingCounter divcounter;
+enum LooperState {
+  LOOPER_IDLE                     = 0,
+  LOOPER_ARMED                    = 1, // waiting for the first onset
+  LOOPER_RECORDING                = 2,
+  LOOPER_PLAYING                  = 3
+};
+
+/*
+  Records the timing of the clock and plays it back in a loop. Once
+  armed, the first rise starts the loop and each rise after it records
+  the interval since the one before, while the clock is passed through.
+  Stopping, a reset or a full recording closes the loop, which then
+  plays from the start: an onset, then the first interval, and so on,
+  the interval from the last onset to the close leading back to the
+  first. A reset during playing starts the loop again, one tick later.
+ */
+template<class Output>
+class ClockLooper {
+public:
+  IntervalRing ring;
+  uint16_t elapsed; // since the last onset recorded, saturating
+  uint16_t interval; // being played
+  uint16_t width;
+  uint16_t gate; // pulse width in timer ticks, 0 half the interval
+  volatile uint16_t pos;
+  volatile uint8_t state;
+  ClockLooper() : elapsed(0), interval(0), width(0), gate(0), pos(0), state(LOOPER_IDLE) {}
+  void clear(){
+    state = LOOPER_IDLE;
+    ring.clear();
+    off();
+  }
+  void arm(){
+    clear();
+    state = LOOPER_ARMED;
+  }
+  /* close the loop and play it */
+  void stop(){
+    if(state == LOOPER_RECORDING)
+      ring.write(elapsed);
+    if(state != LOOPER_PLAYING)
+      state = ring.isEmpty() ? LOOPER_IDLE : LOOPER_PLAYING;
+    if(state == LOOPER_PLAYING)
+      rewind();
+  }
+  inline void reset(){
+    if(state == LOOPER_RECORDING || state == LOOPER_PLAYING)
+      stop();
+    off();
+  }
+  inline void rise(){
+    if(state == LOOPER_ARMED){
+      state = LOOPER_RECORDING;
+    }else if(state == LOOPER_RECORDING){
+      if(!ring.write(elapsed)){
+	// full, the loop closes with this onset
+	state = LOOPER_PLAYING;
+	rewind();
+	return;
+      }
+    }else{
+      return;
+    }
+    elapsed = 0;
+    on();
+  }
+  inline void fall(){
+    if(state == LOOPER_RECORDING)
+      off();
+  }
+  inline void clock(){
+    if(state == LOOPER_RECORDING){
+      if(elapsed != 0xffff)
+	elapsed++;
+    }else if(state == LOOPER_PLAYING){
+      if(++pos == interval){
+	on();
+	next();
+      }else if(pos == width){
+	off();
+      }
+    }
+  }
+  inline void on(){
+    Output::on();
+  }
+  inline void off(){
+    Output::off();
+  }
+  inline bool isOff(){
+    return Output::isOff();
+  }
+#ifdef SERIAL_DEBUG
+  void dump(){
+    static const char* states[] = { "idle", "armed", "recording", "playing" };
+    printString(states[state & 3]);
+    printString(", bytes ");
+    printInteger(ring.length);
+    printString(", interval ");
+    printInteger(interval);
+    if(isOff())
+      printString(" off");
+    else
+      printString(" on");
+  }
+#endif
+private:
+  /* the first onset on the next tick */
+  void rewind(){
+    ring.rewind();
+    pos = 0;
+    interval = 1;
+    width = 0;
+  }
+  inline void next(){
+    pos = 0;
+    interval = ring.next();
+    if(interval < 2)
+      interval = 2; // room for the output to go off between onsets
+    width = gate && gate < interval ? gate : interval >> 1;
+  }
+};
 
+template<class Channel>
 class DelayController {
 public:
+  Channel* channel;
   void update(uint16_t value){
 //     value = (value>>1)+1; // divide by 2, add 1
     value = value+1;
-    delay.value = value;
-    swinger.value = value;
+    channel->delay.value = value;
+    channel->swinger.value = value;
   }
 };
 
+template<class Channel>
 class CounterController : public DeadbandController<CLOCKDELAY_DEADBAND_THRESHOLD> {
 public:
+  Channel* channel;
   void hasChanged(uint16_t v){
     v >>= 7; // scale 0-4095 down to 0-31
-    counter.value = v;
-    divcounter.value = v;
+    channel->counter.value = v;
+    channel->divcounter.value = v;
   }
 };
 
+template<class Channel>
 class DividerController : public DeadbandController<CLOCKDELAY_DEADBAND_THRESHOLD> {
 public:
+  Channel* channel;
   void hasChanged(uint16_t v){
     if(v < (ADC_VALUE_RANGE/32/2))
       v = -1;
     else
       v >>= 7; // scale 0-4095 down to 0-31
-    divider.value = v;
+    channel->divider.value = v;
   }
 };
 
-DelayController delayControl;
-DividerController dividerControl;
-CounterController counterControl;
+/*
+  A clock input with its divide, delay and combined outputs, and the
+  controllers that set them from the knobs. The interrupts call rise(),
+  fall() and tick() on each channel in turn.
+  The clock period is measured in timer ticks from rise to rise. If the
+  clock then does not rise for lossPeriods periods, and not before the
+  last delayed pulse has ended, it is lost: the divided output goes idle
+  and, if the clock stopped high, so do the outputs waiting for it to
+  fall. Delays, gates and bursts already under way play out, and the
+  counts are kept, so a rhythm with rests carries on in phase when the
+  clock comes back.
+ */
+template<class Clock, class DivideOut, class DelayOut, class CombinedOut>
+class ClockChannel {
+public:
+  ClockCounter<DelayOut> counter;
+  ClockDivider<DivideOut> divider;
+  ClockDelay<DelayOut> delay; // manually triggered from Timer0 interrupt
+  ClockDelay<CombinedOut> swinger;
+  ClockCounter<CombinedOut> divcounter;
+  ClockCounter<DelayOut, uint16_t> widecounter;
+  ClockBurst<DelayOut> burst;
+  ClockEuclid<DelayOut> euclid;
+  ClockLooper<DelayOut> looper;
+  RatioDivider ratio;
+  Xorshift16 random;
+  uint16_t threshold; // pulses pass if the next random number is at most this
+  volatile OperatingMode mode;
+  uint8_t lossPeriods; // 0 never quiesces
+  uint16_t sinceRise; // timer ticks, saturating
+  uint16_t lossTicks; // 0 until a period has been measured
+  bool locked; // has risen since a reset or clock loss
+  bool lost; // quiesced, waiting for the clock to return
+  DelayController<ClockChannel> delayControl;
+  DividerController<ClockChannel> dividerControl;
+  CounterController<ClockChannel> counterControl;
+
+  ClockChannel(){
+    delayControl.channel = this;
+    dividerControl.channel = this;
+    counterControl.channel = this;
+    init();
+  }
+  /* the settings and state at power on, also restored by setup() */
+  void init(){
+    dividerControl.value = -1;
+    counterControl.value = -1;
+    setGate(0);
+    random.state = CHANCE_SEED;
+    ratio.num = ratio.den = 1;
+    ratio.reset();
+    looper.clear();
+    lossPeriods = CLOCKDELAY_LOSS_PERIODS;
+    sinceRise = 0;
+    lossTicks = 0;
+    locked = false;
+    lost = false;
+  }
+  inline bool clockIsHigh(){
+    return Clock::isHigh();
+  }
+  void reset(){
+    divider.reset();
+    counter.reset();
+    divcounter.reset();
+    widecounter.reset();
+    delay.reset();
+    swinger.reset();
+    burst.reset();
+    euclid.reset();
+    looper.reset();
+    ratio.reset();
+  }
+  /* with interrupts disabled: the looper is clocked only in loop mode,
+     so leaving it ends the pulse being played */
+  void setMode(OperatingMode m){
+    if(mode == LOOP_MODE && m != LOOP_MODE)
+      looper.off();
+    mode = m;
+  }
+  /* output pulses of a fixed number of ticks, or following the clock with 0 */
+  void setGate(uint16_t ticks){
+    counter.gate = ticks;
+    divcounter.gate = ticks;
+    widecounter.gate = ticks;
+    delay.gate = ticks;
+    swinger.gate = ticks;
+    burst.gate = ticks;
+    euclid.gate = ticks;
+    looper.gate = ticks;
+  }
+  /*
+    Parameters worked out from the divider and counter values in the
+    main loop, to keep the interrupts short: the Euclidean rhythm of
+    divider+1 steps with counter+1 hits, the chance of a pulse passing,
+    counter/CHANCE_LEVELS, the ratio, two divider steps apart, and the
+    wide count.
+   */
+  void prepare(){
+    uint16_t w = pgm_read_word(&wideCounts[counter.value < WIDE_COUNTS ? counter.value : WIDE_COUNTS-1]);
+    if(w != widecounter.value){
+      cli();
+      widecounter.value = w;
+      sei();
+    }
+    uint8_t i = divider.value < 0 ? 0 : (divider.value+1) >> 1;
+    if(i >= RATIOS)
+      i = RATIOS-1;
+    ratio.select(pgm_read_byte(&ratios[i][0]), pgm_read_byte(&ratios[i][1]));
+    euclid.select(divider.value < 0 ? 1 : divider.value+1,
+		  counter.value < EUCLID_MAX_STEPS ? counter.value+1 : EUCLID_MAX_STEPS);
+    // read by the clock interrupt, and two bytes wide
+    uint16_t t = counter.value >= CHANCE_LEVELS ? 0xffff : counter.value*(0xffff/CHANCE_LEVELS);
+    if(t != threshold){
+      cli();
+      threshold = t;
+      sei();
+    }
+  }
+  inline bool chance(){
+    return random.next() <= threshold;
+  }
+  /* Timer 0 overflow */
+  inline void tick(){
+    delay.clock();
+    swinger.clock();
+    counter.clock();
+    divcounter.clock();
+    widecounter.clock();
+    burst.clock();
+    euclid.clock();
+    if(mode == LOOP_MODE)
+      looper.clock();
+    if(sinceRise != 0xffff)
+      sinceRise++;
+    // a loop plays on without the clock
+    if(lossTicks && sinceRise > lossTicks && mode != LOOP_MODE)
+      quiesce();
+  }
+  void quiesce(){
+    divider.quiesce();
+    if(clockIsHigh()){
+      // end the pulses that follow the clock, as fall() would
+      switch(mode){
+      case DELAY_MODE:
+	delay.quiesce();
+	if(divider.toggled)
+	  swinger.quiesce();
+	else
+	  CombinedOut::off();
+	break;
+      case DIVIDE_MODE:
+      case CHANCE_MODE:
+	counter.fall();
+	divcounter.fall();
+	break;
+      case BURST_MODE:
+	CombinedOut::off();
+	break;
+      case EUCLID_MODE:
+	euclid.fall();
+	CombinedOut::off();
+	break;
+      case RATIO_MODE:
+	counter.fall();
+	CombinedOut::off();
+	break;
+      case WIDE_MODE:
+	widecounter.fall();
+	CombinedOut::off();
+	break;
+      case LOOP_MODE:
+      case DISABLED_MODE:
+	break;
+      }
+    }
+    locked = false;
+    lossTicks = 0;
+    lost = true;
+  }
+  /* period of the clock, and the time after which it is lost. A clock
+     faster than the timer has no measured period and is not watched. */
+  inline void measure(){
+    if(locked && lossPeriods && sinceRise){
+      uint32_t t = (uint32_t)sinceRise*lossPeriods;
+      // not before the pulse delayed from this rise has ended, which
+      // lasts the gate or, following the clock, at most a period
+      uint32_t last = (uint32_t)delay.value + (delay.gate ? delay.gate : sinceRise);
+      if(t < last)
+	t = last;
+      // below where sinceRise saturates, so that a slow clock is still lost
+      lossTicks = t > 0xfffe ? 0xfffe : t;
+    }else{
+      lossTicks = 0;
+    }
+    sinceRise = 0;
+    locked = true;
+    lost = false;
+  }
+  inline void rise(){
+    measure();
+    divider.rise();
+    switch(mode){
+    case DELAY_MODE:
+      delay.rise();
+      if(divider.toggled)
+	swinger.rise();
+      else
+	CombinedOut::on(); // pass through clock
+      break;
+    case DIVIDE_MODE:
+      counter.rise();
+      if(divider.toggled && divcounter.rise())
+	divider.toggled = false;
+      break;
+    case BURST_MODE:
+      // counter+1 pulses spread over the delay
+      burst.rise(counter.value+1, delay.value);
+      CombinedOut::on(); // pass through clock
+      break;
+    case EUCLID_MODE:
+      euclid.rise();
+      CombinedOut::on(); // pass through clock
+      break;
+    case CHANCE_MODE:
+      // every clock pulse and every divided pulse, each by chance
+      if(chance())
+	counter.fire();
+      else
+	counter.skip();
+      if(divider.toggled){
+	divider.toggled = false;
+	if(chance())
+	  divcounter.fire();
+	else
+	  divcounter.skip();
+      }
+      break;
+    case LOOP_MODE:
+      looper.rise();
+      CombinedOut::on(); // pass through clock
+      break;
+    case RATIO_MODE:
+      if(ratio.next())
+	counter.fire();
+      else
+	counter.skip();
+      CombinedOut::on(); // pass through clock
+      break;
+    case WIDE_MODE:
+      widecounter.rise();
+      CombinedOut::on(); // pass through clock
+      break;
+    case DISABLED_MODE:
+      break;
+    }
+  }
+  inline void fall(){
+    switch(mode){
+    case DELAY_MODE:
+      delay.fall();
+      if(divider.toggled){
+	swinger.fall();
+	divider.toggled = false;
+      }else{
+	CombinedOut::off(); // pass through clock
+      }
+      break;
+    case DIVIDE_MODE:
+      counter.fall();
+      divcounter.fall();
+      break;
+    case BURST_MODE:
+      CombinedOut::off();
+      break;
+    case EUCLID_MODE:
+      euclid.fall();
+      CombinedOut::off();
+      break;
+    case CHANCE_MODE:
+      counter.fall();
+      divcounter.fall();
+      break;
+    case LOOP_MODE:
+      looper.fall();
+      CombinedOut::off();
+      break;
+    case RATIO_MODE:
+      counter.fall();
+      CombinedOut::off();
+      break;
+    case WIDE_MODE:
+      widecounter.fall();
+      CombinedOut::off();
+      break;
+    case DISABLED_MODE:
+      break;
+    }
+    divider.fall();
+  }
+};
+
+typedef ClockChannel<ClockInput, DivideOutput, DelayOutput, CombinedOutput> Channel;
+
+DEVICE_STATE Channel channel;
+
+#ifdef EVENT_TRACE
+DEVICE_STATE EventTrace eventTrace;
+// timestamped with timerTicks, the one tick counter
+#define TRACE_EVENT(type) eventTrace.record(type, DIVIDE_OUTPUT_PINS, timerTicks)
+#define TRACE_TIMER() eventTrace.recordChange(EVENT_TRACE_TIMER, DIVIDE_OUTPUT_PINS, timerTicks)
+#else
+#define TRACE_EVENT(type)
+#define TRACE_TIMER()
+#endif
+
+#ifdef ISR_PROFILE
+DEVICE_STATE IsrProfile isrProfiles[ISR_PROFILE_VECTORS];
+#endif
 
 void reset(){
-  divider.reset();
-  counter.reset();
-  divcounter.reset();
-  delay.reset();
-  swinger.reset();
+  channel.reset();
+}
+
+// Timer 0 overflows, every 128us
+DEVICE_STATE volatile uint16_t timerTicks;
+
+inline uint16_t ticks(){
+  cli();
+  uint16_t t = timerTicks;
+  sei();
+  return t;
+}
+
+// startup is complete, see setup()
+DEVICE_STATE bool started;
+// timer ticks from setup() to start()
+DEVICE_STATE uint16_t readyTicks;
+
+inline bool isValidMode(uint8_t m){
+  return m == DIVIDE_MODE || m == DELAY_MODE || m == BURST_MODE || m == EUCLID_MODE ||
+    m == CHANCE_MODE || m == LOOP_MODE || m == RATIO_MODE || m == WIDE_MODE;
+}
+
+#ifdef SERIAL_DEBUG
+// parameters set over serial, which are not updated from knobs and switch
+DEVICE_STATE uint8_t remoteControl;
+
+DEVICE_STATE PresetStore presets;
+
+/* the parameters set over serial are kept, those set from the knobs come back from the knobs */
+Preset currentPreset(){
+  Preset p;
+  memset(&p, 0, sizeof(p));
+  p.flags = remoteControl;
+  if(remoteControl & COMMAND_MODE)
+    p.mode = channel.mode;
+  if(remoteControl & COMMAND_DIVIDER)
+    p.divider = channel.divider.value;
+  if(remoteControl & COMMAND_COUNTER)
+    p.counter = channel.counter.value;
+  if(remoteControl & COMMAND_DELAY)
+    p.delay = channel.delay.value;
+  p.lossPeriods = channel.lossPeriods;
+  p.gate = channel.delay.gate;
+  return p;
+}
+
+/* called at boot, before the clock and reset interrupts are enabled */
+void restorePreset(){
+  remoteControl = 0;
+  Preset p = currentPreset();
+  if(!presets.restore(p))
+    return;
+  channel.lossPeriods = p.lossPeriods;
+  channel.setGate(p.gate);
+  if(!isValidMode(p.mode))
+    p.flags &= ~COMMAND_MODE;
+  remoteControl = p.flags & (COMMAND_DIVIDER|COMMAND_COUNTER|COMMAND_DELAY|COMMAND_MODE);
+  if(remoteControl & COMMAND_MODE)
+    channel.mode = (OperatingMode)p.mode;
+  if(remoteControl & COMMAND_DIVIDER)
+    channel.divider.value = p.divider;
+  if(remoteControl & COMMAND_COUNTER){
+    channel.counter.value = p.counter;
+    channel.divcounter.value = p.counter;
+  }
+  if(remoteControl & COMMAND_DELAY){
+    channel.delay.value = p.delay;
+    channel.swinger.value = p.delay;
+  }
+}
+#endif
+
+#ifdef LATENCY_HISTOGRAM
+#define LATENCY_DIVIDE             0
+#define LATENCY_DELAY              1
+#define LATENCY_COMBINED           2
+#define LATENCY_OUTPUTS            3
+#define LATENCY_SETS               3
+// one histogram per output in divide mode, delay mode and the serial only modes
+DEVICE_STATE LatencyHistogram latency[LATENCY_SETS*LATENCY_OUTPUTS];
+// ideal activation times of the timer driven outputs
+DEVICE_STATE uint16_t delayIdeal;
+DEVICE_STATE uint16_t swingIdeal;
+
+/* Timer 0 count extended to 16 bits with the low byte of timerTicks */
+inline uint16_t latencyTime(){
+  uint8_t t = TCNT0;
+  uint8_t h = timerTicks;
+  if((TIFR0 & _BV(TOV0)) && t < 0x80)
+    h++; // overflow is pending but not yet serviced
+  return (h << 8) | t;
+}
+
+/* record the outputs that have become active since 'before' was read */
+inline void measureLatency(uint8_t before, uint16_t divideAt, uint16_t delayAt, uint16_t combinedAt){
+  // outputs are active low
+  uint8_t activated = before & ~DIVIDE_OUTPUT_PINS;
+  if(activated & (_BV(DIVIDE_OUTPUT_PIN)|_BV(DELAY_OUTPUT_PIN)|_BV(COMBINED_OUTPUT_PIN))){
+    uint16_t now = latencyTime();
+    LatencyHistogram* h = latency;
+    if(channel.mode == DELAY_MODE)
+      h += LATENCY_OUTPUTS;
+    else if(channel.mode != DIVIDE_MODE)
+      h += 2*LATENCY_OUTPUTS;
+    if(activated & _BV(DIVIDE_OUTPUT_PIN))
+      h[LATENCY_DIVIDE].add(now - divideAt);
+    if(activated & _BV(DELAY_OUTPUT_PIN))
+      h[LATENCY_DELAY].add(now - delayAt);
+    if(activated & _BV(COMBINED_OUTPUT_PIN))
+      h[LATENCY_COMBINED].add(now - combinedAt);
+  }
+}
+
+/* the delays are due at their ideal times, anything else the timer starts on this tick */
+inline void measureTimerLatency(uint8_t before){
+  if(channel.mode == DELAY_MODE){
+    measureLatency(before, 0, delayIdeal, swingIdeal);
+  }else{
+    uint16_t tick = (uint8_t)timerTicks << 8;
+    measureLatency(before, tick, tick, tick);
+  }
 }
 
-volatile OperatingMode mode;
+#define LATENCY_ENTER() uint16_t latencyEdge = latencyTime(); uint8_t latencyOutputs = DIVIDE_OUTPUT_PINS
+// in delay mode the delay is started on every rise, the swing on divider toggles
+#define LATENCY_SCHEDULE(ch) if((ch).mode == DELAY_MODE){ \
+    delayIdeal = latencyEdge + ((ch).delay.riseMark << 8); \
+    if((ch).divider.toggled) swingIdeal = latencyEdge + ((ch).swinger.riseMark << 8); }
+#define LATENCY_EXIT() measureLatency(latencyOutputs, latencyEdge, latencyEdge, latencyEdge)
+#define LATENCY_TIMER_ENTER() uint8_t latencyOutputs = DIVIDE_OUTPUT_PINS
+#define LATENCY_TIMER_EXIT() measureTimerLatency(latencyOutputs)
+#else
+#define LATENCY_ENTER()
+#define LATENCY_SCHEDULE(ch)
+#define LATENCY_EXIT()
+#define LATENCY_TIMER_ENTER()
+#define LATENCY_TIMER_EXIT()
+#endif
+
+inline void selectMode(OperatingMode m){
+  if(channel.mode != m){
+    cli();
+    channel.setMode(m);
+    sei();
+  }
+}
 
+/* the switch only knows divide and delay mode, see OperatingMode */
 inline void updateMode(){
+#ifdef SERIAL_DEBUG
+  if(remoteControl & COMMAND_MODE)
+    return;
+#endif
   if(isCountMode()){
-    mode = DIVIDE_MODE;
+    selectMode(DIVIDE_MODE);
   }else if(isDelayMode()){
     cli();
     reset();
     while(isDelayMode());
     sei();
   }else{
-    mode = DELAY_MODE;
+    selectMode(DELAY_MODE);
   }
 }
 
+/*
+  Startup: the outputs are set idle before they are driven, and the clock
+  and reset interrupts stay disabled until the knobs have been read. Timer 0
+  runs from the start, to measure the time to ready: restoring the preset,
+  about 0.6ms for 1k bytes of EEPROM, then the ADC takes 16 conversions,
+  1.7ms, to deliver its first complete frame, the first being dropped. The
+  first loop() pass after that sets the controllers from the knobs and
+  enables the interrupts, 13 timer ticks after setup() is entered when
+  the preset takes no time, as in the host tests, and about 18 on the
+  device.
+ */
 void setup(){
   cli();
 
@@ -311,7 +1250,8 @@ void setup(){
   // trigger int0 on the falling edge, since input is inverted
   // trigger int1 on any logical change.
   // pulses that last longer than one clock period will generate an interrupt.
-  EIMSK =  (1<<INT1) | (1<<INT0); // enables INT0 and INT1
+  // INT0 and INT1 are enabled by start(), once the knobs have been read
+  EIMSK = 0;
   CLOCKDELAY_CLOCK_DDR &= ~_BV(CLOCKDELAY_CLOCK_PIN);
   CLOCKDELAY_CLOCK_PORT |= _BV(CLOCKDELAY_CLOCK_PIN); // enable pull-up resistor
 
@@ -323,13 +1263,8 @@ void setup(){
   MODE_SWITCH_DDR &= ~_BV(MODE_SWITCH_PIN_B);
   MODE_SWITCH_PORT |= _BV(MODE_SWITCH_PIN_B);
 
-  DIVIDE_OUTPUT_DDR |= _BV(DIVIDE_OUTPUT_PIN);
-  DELAY_OUTPUT_DDR |= _BV(DELAY_OUTPUT_PIN);
-  COMBINED_OUTPUT_DDR |= _BV(COMBINED_OUTPUT_PIN);
-  CLOCKDELAY_LEDS_DDR |= _BV(CLOCKDELAY_LED_1_PIN);
-  CLOCKDELAY_LEDS_DDR |= _BV(CLOCKDELAY_LED_2_PIN);
-  CLOCKDELAY_LEDS_DDR |= _BV(CLOCKDELAY_LED_3_PIN);
-
+  // idle levels first: a pin made an output while its port bit is still
+  // low would drive the inverted output high, a spurious pulse
   DIVIDE_OUTPUT_PORT |= _BV(DIVIDE_OUTPUT_PIN);
   DELAY_OUTPUT_PORT |= _BV(DELAY_OUTPUT_PIN);
   COMBINED_OUTPUT_PORT |= _BV(COMBINED_OUTPUT_PIN);
@@ -337,6 +1272,13 @@ void setup(){
   CLOCKDELAY_LEDS_PORT &= ~_BV(CLOCKDELAY_LED_2_PIN);
   CLOCKDELAY_LEDS_PORT &= ~_BV(CLOCKDELAY_LED_3_PIN);
 
+  DIVIDE_OUTPUT_DDR |= _BV(DIVIDE_OUTPUT_PIN);
+  DELAY_OUTPUT_DDR |= _BV(DELAY_OUTPUT_PIN);
+  COMBINED_OUTPUT_DDR |= _BV(COMBINED_OUTPUT_PIN);
+  CLOCKDELAY_LEDS_DDR |= _BV(CLOCKDELAY_LED_1_PIN);
+  CLOCKDELAY_LEDS_DDR |= _BV(CLOCKDELAY_LED_2_PIN);
+  CLOCKDELAY_LEDS_DDR |= _BV(CLOCKDELAY_LED_3_PIN);
+
   // At 16MHz CPU clock and prescaler 64, Timer 0 should run at 1024Hz.
   // configure Timer 0 to Fast PWM, 0xff top.
   TCCR0A |= _BV(WGM01) | _BV(WGM00);
@@ -344,123 +1286,435 @@ void setup(){
   TCCR0B |= _BV(CS01);  // prescaler: 8
   // enable timer 0 overflow interrupt
   TIMSK0 |= _BV(TOIE0);
+  timerTicks = 0;
+  started = false;
 
 //   dividerControl.range = 33;
-  dividerControl.value = -1;
 //   counterControl.range = 33;
-  counterControl.value = -1;
+  channel.init();
 
-  setup_adc();
+#ifdef ISR_PROFILE
+  setup_profiler();
+#endif
+#ifdef LATENCY_HISTOGRAM
+  for(uint8_t i=0; i<LATENCY_SETS*LATENCY_OUTPUTS; ++i)
+    latency[i].reset();
+#endif
   reset();
-  updateMode();
 
   sei();
 
+#ifdef SERIAL_DEBUG
+  restorePreset();
+#endif
+  setup_adc();
+  updateMode();
 #ifdef SERIAL_DEBUG
   beginSerial(9600);
+#endif
+}
+
+/* called by the first loop() pass with a complete ADC frame, after the controllers are set */
+void start(){
+  cli();
+  reset();
+  EIFR = _BV(INTF1) | _BV(INTF0); // discard edges seen while starting
+  EIMSK = _BV(INT1) | _BV(INT0);
+  readyTicks = timerTicks;
+  started = true;
+  sei();
+#ifdef SERIAL_DEBUG
   printString("hello\n");
 #endif
 }
 
 /* Timer 0 overflow interrupt */
 ISR(TIMER0_OVF_vect){
-  delay.clock();
-  swinger.clock();
+  PROFILE_ENTER();
+  timerTicks++; // before anything that reads the time
+  LATENCY_TIMER_ENTER();
+  channel.tick();
+  TRACE_TIMER();
+  LATENCY_TIMER_EXIT();
+  PROFILE_EXIT(ISR_PROFILE_TIMER0);
 }
 
 /* Reset interrupt */
 ISR(INT0_vect){
   reset();  
+  TRACE_EVENT(EVENT_TRACE_RESET);
   // hold everything until reset is released
   while(resetIsHigh());
 }
 
+/* clock edge handling, shared by the interrupt and the serial injector */
+inline void clockRise(){
+  channel.rise();
+  TRACE_EVENT(EVENT_TRACE_RISE);
+}
+
+inline void clockFall(){
+  channel.fall();
+  TRACE_EVENT(EVENT_TRACE_FALL);
+}
+
 /* Clock interrupt */
 ISR(INT1_vect){
-  if(clockIsHigh()){
-    divider.rise();
-    switch(mode){
-    case DELAY_MODE:
-      delay.rise();
-      if(divider.toggled){
-	swinger.rise();
-      }else{
-	COMBINED_OUTPUT_PORT &= ~_BV(COMBINED_OUTPUT_PIN); // pass through clock
-	CLOCKDELAY_LEDS_PORT |= _BV(CLOCKDELAY_LED_1_PIN);
-      }
-      break;
-    case DIVIDE_MODE:
-      counter.rise();
-      if(divider.toggled){
-	divcounter.rise();
-	if(!divcounter.isOff())
-	  divider.toggled = false;
-      }
-      break;
-    }
+  PROFILE_ENTER();
+  LATENCY_ENTER();
+  if(channel.clockIsHigh()){
+    clockRise();
+    LATENCY_SCHEDULE(channel);
   }else{
-    switch(mode){
-    case DELAY_MODE:
-      delay.fall();
-      if(divider.toggled){
-	swinger.fall();
-	divider.toggled = false;
-      }else{
-	COMBINED_OUTPUT_PORT |= _BV(COMBINED_OUTPUT_PIN); // pass through clock
-	CLOCKDELAY_LEDS_PORT &= ~_BV(CLOCKDELAY_LED_1_PIN);
-      }
-      break;
-    case DIVIDE_MODE:
-      counter.fall();
-      divcounter.fall();
-      break;
-    }
-    divider.fall();
+    clockFall();
   }
+  LATENCY_EXIT();
+  PROFILE_EXIT(ISR_PROFILE_INT1);
 }
 
-void loop(){
-  updateMode();
-  dividerControl.update(getAnalogValue(DIVIDE_ADC_CHANNEL));
-  counterControl.update(getAnalogValue(DELAY_ADC_CHANNEL));
-  delayControl.update(getAnalogValue(DELAY_ADC_CHANNEL));
-  
 #ifdef SERIAL_DEBUG
-  if(serialAvailable() > 0){
-    switch(serialRead()){
-    case '.':
-      CLOCKDELAY_CLOCK_PORT ^= _BV(CLOCKDELAY_CLOCK_PIN);
-      INT1_vect();
-      break;
-    case ':':
-      CLOCKDELAY_RESET_PORT &= ~_BV(CLOCKDELAY_RESET_PIN);
-      TIMER0_OVF_vect();
-      CLOCKDELAY_RESET_PORT |= _BV(CLOCKDELAY_RESET_PIN);
-      TIMER0_OVF_vect();
-      break;
-    }      
+DEVICE_STATE SerialCommandParser commandParser;
+
+#ifdef LATENCY_HISTOGRAM
+void dump(LatencyHistogram& histogram){
+  cli();
+  LatencyHistogram h = histogram;
+  sei();
+  printString("n ");
+  printInteger(h.count());
+  if(h.count()){
+    printString(", min ");
+    printInteger(h.min);
+    printString(", max ");
+    printInteger(h.max);
+  }
+  printString(", bins");
+  for(uint8_t i=0; i<LATENCY_BINS; ++i){
+    printByte(' ');
+    printInteger(h.bins[i]);
+  }
+}
+
+void dumpLatency(){
+  static const char* sets[] = { "count ", "delay ", "serial " };
+  static const char* names[] = { "div ", "del ", "comb " };
+  for(uint8_t i=0; i<LATENCY_SETS*LATENCY_OUTPUTS; ++i){
+    printString(sets[i / LATENCY_OUTPUTS]);
+    printString(names[i % LATENCY_OUTPUTS]);
+    printByte('[');
+    dump(latency[i]);
+    printByte(']');
+    printNewline();
+  }
+}
+#endif
+
+#ifdef ISR_PROFILE
+void dump(IsrProfile& profile){
+  // copy with interrupts disabled, the ISR may update the stats mid-print
+  cli();
+  IsrProfile p = profile;
+  sei();
+  printString("min ");
+  printInteger(p.count ? p.min : 0);
+  printString(", max ");
+  printInteger(p.max);
+  printString(", mean ");
+  printInteger(p.mean());
+  printString(", count ");
+  printInteger(p.count);
+}
+#endif
+
+/* the status fields on the line after "ok ", and the reports after them on lines of their own */
+void dump(uint16_t fields){
+  bool open = true; // nothing has ended the "ok " line
+  if(fields & STATUS_DIVIDER){
     printString("div[");
-    divider.dump();
+    channel.divider.dump();
     printString("] ");
+    if(channel.mode == RATIO_MODE){
+      printString("ratio[");
+      channel.ratio.dump();
+      printString("] ");
+    }
+  }
+  if(fields & STATUS_COUNTER){
     printString("cnt[");
-    counter.dump();
+    channel.counter.dump();
     printString("] ");
+    if(channel.mode == WIDE_MODE){
+      printString("wide[");
+      channel.widecounter.dump();
+      printString("] ");
+    }
+    if(channel.mode == EUCLID_MODE){
+      printString("euclid[");
+      channel.euclid.dump();
+      printString("] ");
+    }
+  }
+  if(fields & STATUS_DELAY){
     printString("del[");
-    delay.dump();
+    channel.delay.dump();
     printString("] ");
+    if(channel.mode == BURST_MODE){
+      printString("burst[");
+      channel.burst.dump();
+      printString("] ");
+    }
+    if(channel.mode == LOOP_MODE){
+      printString("loop[");
+      channel.looper.dump();
+      printString("] ");
+    }
+  }
+  if(fields & STATUS_SWING){
     printString("swing[");
-    swinger.dump();
+    channel.swinger.dump();
     printString("] ");
+  }
+  if(fields & STATUS_OUTPUTS)
     printBinary(DELAY_OUTPUT_PINS);
-    switch(mode){
+  if(fields & STATUS_MODE){
+    switch(channel.mode){
     case DIVIDE_MODE:
       printString(" count ");
       break;
     case DELAY_MODE:
       printString(" delay ");
       break;
+    case BURST_MODE:
+      printString(" burst ");
+      break;
+    case EUCLID_MODE:
+      printString(" euclid ");
+      break;
+    case CHANCE_MODE:
+      printString(" chance ");
+      break;
+    case LOOP_MODE:
+      printString(" loop ");
+      break;
+    case RATIO_MODE:
+      printString(" ratio ");
+      break;
+    case WIDE_MODE:
+      printString(" wide ");
+      break;
+    case DISABLED_MODE:
+      break;
     }
+    if(channel.lost)
+      printString("lost ");
+  }
+  if(fields & STATUS_ALL){
     printNewline();
+    open = false;
   }
+#ifdef EVENT_TRACE
+  if((fields & STATUS_TRACE) && eventTrace.size()){
+    eventTrace.dump();
+    open = false;
+  }
+#endif
+#ifdef ISR_PROFILE
+  if(fields & STATUS_PROFILE){
+    printString("int1[");
+    dump(isrProfiles[ISR_PROFILE_INT1]);
+    printString("] timer0[");
+    dump(isrProfiles[ISR_PROFILE_TIMER0]);
+    printString("] adc[");
+    dump(isrProfiles[ISR_PROFILE_ADC]);
+    printString("]");
+    printNewline();
+    open = false;
+  }
+#endif
+#ifdef LATENCY_HISTOGRAM
+  if(fields & STATUS_LATENCY){
+    dumpLatency();
+    open = false;
+  }
+#endif
+  if(fields & STATUS_BOOT){
+    printString("ready ");
+    printInteger(readyTicks);
+    printString(" ticks");
+    printNewline();
+    open = false;
+  }
+#ifdef STACK_MONITOR
+  if(fields & STATUS_STACK){
+    printString("static ");
+    printInteger(staticSize());
+    printString(", stack used ");
+    printInteger(stackUsed());
+    printString(", unused ");
+    printInteger(stackUnused());
+    printString(", free ");
+    printInteger(stackFree());
+    printNewline();
+    open = false;
+  }
+#endif
+  if(open)
+    printNewline();
+}
+
+/* drive the clock input from software, as if the edge came from the jack.
+ * Each edge is atomic on its own; interrupts are enabled in between so
+ * that the timer and serial reception keep running during a long batch. */
+void injectClock(bool high){
+  cli();
+  if(high){
+    CLOCKDELAY_CLOCK_PORT &= ~_BV(CLOCKDELAY_CLOCK_PIN);
+    clockRise();
+  }else{
+    CLOCKDELAY_CLOCK_PORT |= _BV(CLOCKDELAY_CLOCK_PIN);
+    clockFall();
+  }
+  EIFR = _BV(INTF1); // discard the edge raised by toggling the pull-up
+  sei();
+}
+
+void localControl(){
+  remoteControl = 0;
+  channel.dividerControl.hasChanged(channel.dividerControl.value);
+  channel.counterControl.hasChanged(channel.counterControl.value);
+}
+
+bool applyCommand(SerialCommand& cmd){
+  if((cmd.flags & COMMAND_MODE) && !isValidMode(cmd.mode))
+    return false;
+  // apply all settings in one go, with no clock or timer events in between
+  cli();
+  if(cmd.flags & COMMAND_LOCAL)
+    localControl();
+  if(cmd.flags & COMMAND_DIVIDER)
+    channel.divider.value = cmd.divider;
+  if(cmd.flags & COMMAND_COUNTER){
+    channel.counter.value = cmd.counter;
+    channel.divcounter.value = cmd.counter;
+  }
+  if(cmd.flags & COMMAND_DELAY){
+    channel.delay.value = cmd.delay;
+    channel.swinger.value = cmd.delay;
+  }
+  if(cmd.flags & COMMAND_MODE)
+    channel.setMode((OperatingMode)cmd.mode);
+  if(cmd.flags & COMMAND_GATE)
+    channel.setGate(cmd.gate);
+  if(cmd.flags & COMMAND_SEED)
+    channel.random.state = cmd.seed;
+  if(cmd.flags & COMMAND_LOOP){
+    if(cmd.loop)
+      channel.looper.arm();
+    else
+      channel.looper.stop();
+  }
+  if(cmd.flags & COMMAND_WATCHDOG){
+    channel.lossPeriods = cmd.lossPeriods;
+    channel.lossTicks = 0; // until the next rise
+  }
+  remoteControl |= cmd.flags & (COMMAND_DIVIDER|COMMAND_COUNTER|COMMAND_DELAY|COMMAND_MODE);
+  if(cmd.flags & COMMAND_RESET)
+    reset();
+#ifdef EVENT_TRACE
+  if((cmd.flags & COMMAND_CLEAR) && (cmd.clear & STATUS_TRACE))
+    eventTrace.clear();
+  if(cmd.flags & COMMAND_FREEZE)
+    eventTrace.frozen = true;
+#endif
+#ifdef ISR_PROFILE
+  if((cmd.flags & COMMAND_CLEAR) && (cmd.clear & STATUS_PROFILE)){
+    for(uint8_t i=0; i<ISR_PROFILE_VECTORS; ++i)
+      isrProfiles[i].reset();
+  }
+#endif
+#ifdef LATENCY_HISTOGRAM
+  if((cmd.flags & COMMAND_CLEAR) && (cmd.clear & STATUS_LATENCY)){
+    for(uint8_t i=0; i<LATENCY_SETS*LATENCY_OUTPUTS; ++i)
+      latency[i].reset();
+  }
+#endif
+#ifdef STACK_MONITOR
+  if((cmd.flags & COMMAND_CLEAR) && (cmd.clear & STATUS_STACK))
+    stackRepaint();
+#endif
+  sei();
+  // pulses see the new settings, but are not part of the atomic update
+  if(cmd.flags & COMMAND_PULSES){
+    for(uint16_t i=0; i<cmd.pulses; ++i){
+      injectClock(true);
+      injectClock(false);
+    }
+  }
+  return true;
+}
+
+void serialCommand(){
+  char c = serialRead();
+  if(commandParser.isEmpty()){
+    switch(c){
+    case '.':
+      injectClock(!channel.clockIsHigh());
+      dump(STATUS_ALL);
+      return;
+    case ':':
+      CLOCKDELAY_RESET_PORT &= ~_BV(CLOCKDELAY_RESET_PIN);
+      TIMER0_OVF_vect();
+      CLOCKDELAY_RESET_PORT |= _BV(CLOCKDELAY_RESET_PIN);
+      TIMER0_OVF_vect();
+      dump(STATUS_ALL);
+      return;
+    }
+  }
+  SerialCommand cmd;
+  switch(commandParser.receive(c, cmd)){
+  case SerialCommandParser::COMPLETE:
+    if(applyCommand(cmd)){
+      printString("ok ");
+      if(cmd.flags & COMMAND_STATUS)
+	dump(cmd.status);
+      else
+	printNewline();
+      break;
+    }
+    // fall through
+  case SerialCommandParser::MALFORMED:
+    printString("err\n");
+    break;
+  default:
+    break;
+  }
+}
+#endif
+
+void loop(){
+  if(!started && !adc_ready)
+    return; // hold the controllers until the knobs have been read
+  updateMode();
+#ifdef SERIAL_DEBUG
+  if(!(remoteControl & COMMAND_DIVIDER))
+    channel.dividerControl.update(getAnalogValue(DIVIDE_ADC_CHANNEL));
+  if(!(remoteControl & COMMAND_COUNTER))
+    channel.counterControl.update(getAnalogValue(DELAY_ADC_CHANNEL));
+  if(!(remoteControl & COMMAND_DELAY))
+    channel.delayControl.update(getAnalogValue(DELAY_ADC_CHANNEL));
+#else
+  channel.dividerControl.update(getAnalogValue(DIVIDE_ADC_CHANNEL));
+  channel.counterControl.update(getAnalogValue(DELAY_ADC_CHANNEL));
+  channel.delayControl.update(getAnalogValue(DELAY_ADC_CHANNEL));
+#endif
+  channel.prepare();
+  if(!started)
+    start();
+#ifdef SERIAL_DEBUG
+  while(serialAvailable() > 0)
+    serialCommand();
+  uint16_t now = ticks();
+  presets.save(currentPreset(), now);
+  presets.service(now);
 #endif
 }
@@ -0,0 +1,154 @@
+/*
+Host side throughput benchmark of the clock processing code.
+make bench
+writes build/ClockDelayBench.json, or run with: ClockDelayBench [output.json] [edges]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+
+#include <avr/io.h>
+
+#include "ClockDelay.cpp"
+
+typedef std::chrono::steady_clock Clock;
+
+struct Result {
+  const char* name;
+  uint64_t edges;
+  double seconds;
+};
+
+/* time 'edges' clock edges through fn, which handles one rise and one fall per call.
+ * The barrier after each call makes the compiler write the state back to
+ * memory, so that it cannot fold the calls of a simple path into one. */
+template<class Fn>
+Result run(const char* name, uint64_t edges, Fn fn){
+  Clock::time_point start = Clock::now();
+  for(uint64_t i=0; i<edges/2; ++i){
+    fn(i);
+    asm volatile("" ::: "memory");
+  }
+  Clock::time_point stop = Clock::now();
+  Result r;
+  r.name = name;
+  r.edges = edges/2*2;
+  r.seconds = std::chrono::duration<double>(stop-start).count();
+  return r;
+}
+
+void clockHigh(){
+  PIND &= ~_BV(CLOCKDELAY_CLOCK_PIN);
+  INT1_vect();
+}
+
+void clockLow(){
+  PIND |= _BV(CLOCKDELAY_CLOCK_PIN);
+  INT1_vect();
+}
+
+// timer ticks per clock edge, roughly a 24ppqn clock at 120bpm
+const int edgeTicks = 80;
+
+/* one clock period through the interrupts, with the timer running */
+void clockWithTicks(uint64_t){
+  clockHigh();
+  for(int t=0; t<edgeTicks/2; ++t)
+    TIMER0_OVF_vect();
+  clockLow();
+  for(int t=0; t<edgeTicks/2; ++t)
+    TIMER0_OVF_vect();
+}
+
+/* as clockWithTicks, in the given mode after the main loop has set it up */
+Result runMode(const char* name, uint64_t edges, OperatingMode mode){
+  reset();
+  channel.mode = mode;
+  channel.prepare();
+  return run(name, edges, clockWithTicks);
+}
+
+int main(int argc, char** argv){
+  const char* filename = argc > 1 ? argv[1] : "build/ClockDelayBench.json";
+  uint64_t edges = argc > 2 ? strtoull(argv[2], NULL, 10) : 10000000;
+  setup();
+  PIND |= _BV(CLOCKDELAY_CLOCK_PIN) | _BV(CLOCKDELAY_RESET_PIN);
+  PIND |= _BV(MODE_SWITCH_PIN_A) | _BV(MODE_SWITCH_PIN_B);
+  remoteControl = COMMAND_DIVIDER|COMMAND_COUNTER|COMMAND_DELAY|COMMAND_MODE;
+  channel.divider.value = 7;
+  channel.counter.value = 5;
+  channel.divcounter.value = 5;
+  channel.delay.value = edgeTicks/2;
+  channel.swinger.value = edgeTicks/2;
+
+  Result results[13];
+  int n = 0;
+  reset();
+  results[n++] = run("divider", edges, [](uint64_t){
+      channel.divider.rise();
+      channel.divider.fall();
+    });
+  results[n++] = run("counter", edges, [](uint64_t){
+      channel.counter.rise();
+      channel.counter.fall();
+    });
+  results[n++] = run("delay", edges, [](uint64_t){
+      channel.delay.rise();
+      for(int t=0; t<edgeTicks/2; ++t)
+	channel.delay.clock();
+      channel.delay.fall();
+      for(int t=0; t<edgeTicks/2; ++t)
+	channel.delay.clock();
+    });
+  results[n++] = run("swing", edges, [](uint64_t){
+      channel.swinger.rise();
+      for(int t=0; t<edgeTicks/2; ++t)
+	channel.swinger.clock();
+      channel.swinger.fall();
+      for(int t=0; t<edgeTicks/2; ++t)
+	channel.swinger.clock();
+    });
+  reset();
+  channel.mode = DIVIDE_MODE;
+  results[n++] = run("int1_divide_mode", edges, [](uint64_t){
+      clockHigh();
+      clockLow();
+    });
+  reset();
+  channel.mode = DELAY_MODE;
+  results[n++] = run("int1_delay_mode", edges, [](uint64_t){
+      clockHigh();
+      clockLow();
+    });
+  results[n++] = run("timer0", edges, [](uint64_t){
+      TIMER0_OVF_vect();
+      TIMER0_OVF_vect();
+    });
+  results[n++] = runMode("delay_mode_with_ticks", edges, DELAY_MODE);
+  results[n++] = runMode("burst_mode_with_ticks", edges, BURST_MODE);
+  results[n++] = runMode("euclid_mode_with_ticks", edges, EUCLID_MODE);
+  results[n++] = runMode("chance_mode_with_ticks", edges, CHANCE_MODE);
+  results[n++] = runMode("ratio_mode_with_ticks", edges, RATIO_MODE);
+  results[n++] = runMode("wide_mode_with_ticks", edges, WIDE_MODE);
+
+  FILE* file = fopen(filename, "w");
+  if(file == NULL){
+    perror(filename);
+    return 1;
+  }
+  fprintf(file, "{\n  \"edges\": %llu,\n  \"ticks_per_edge\": %d,\n  \"benchmarks\": [\n",
+	  (unsigned long long)edges, edgeTicks/2);
+  printf("%-24s %14s %10s\n", "path", "edges/s", "ns/edge");
+  for(int i=0; i<n; ++i){
+    Result& r = results[i];
+    double rate = r.edges/r.seconds;
+    double ns = r.seconds*1e9/r.edges;
+    printf("%-24s %14.0f %10.2f\n", r.name, rate, ns);
+    fprintf(file, "    { \"name\": \"%s\", \"edges\": %llu, \"seconds\": %.6f, \"edges_per_second\": %.0f, \"ns_per_edge\": %.3f }%s\n",
+	    r.name, (unsigned long long)r.edges, r.seconds, rate, ns, i+1 < n ? "," : "");
+  }
+  fprintf(file, "  ]\n}\n");
+  fclose(file);
+  return 0;
+}
@@ -0,0 +1,47 @@
+/*
+Generates EuclidPatterns.h, the Euclidean rhythms read by the firmware.
+make euclid-patterns
+or: ClockDelayEuclid > EuclidPatterns.h
+For every step count up to 32 and every hit count up to the step count,
+one bitmask with bit i set if step i is a hit. Step i is a hit if
+(i*hits) mod steps < hits: the hits spread as evenly as they can be, and
+the first step is always a hit, so E(3,8) is x..x..x.
+*/
+
+#include <stdio.h>
+#include <inttypes.h>
+
+#define MAX_STEPS                  32
+
+uint32_t pattern(unsigned steps, unsigned hits){
+  uint32_t bits = 0;
+  for(unsigned i=0; i<steps; ++i)
+    if(i*hits % steps < hits)
+      bits |= (uint32_t)1 << i;
+  return bits;
+}
+
+int main(){
+  printf("/* Generated by ClockDelayEuclid, do not edit: make euclid-patterns */\n");
+  printf("#ifndef _EUCLID_PATTERNS_H_\n");
+  printf("#define _EUCLID_PATTERNS_H_\n\n");
+  printf("#include <inttypes.h>\n");
+  printf("#include <avr/pgmspace.h>\n\n");
+  printf("#define EUCLID_MAX_STEPS           %d\n", MAX_STEPS);
+  printf("/* index of the pattern of 'hits' in 'steps', for 1 <= hits <= steps */\n");
+  printf("#define EUCLID_INDEX(steps, hits)  ((uint16_t)((steps)-1)*(steps)/2 + (hits)-1)\n\n");
+  printf("/* bit i is set if step i is a hit */\n");
+  printf("const uint32_t euclidPatterns[] PROGMEM = {\n");
+  for(unsigned steps=1; steps<=MAX_STEPS; ++steps){
+    printf("  // %u step%s\n ", steps, steps == 1 ? "" : "s");
+    for(unsigned hits=1; hits<=steps; ++hits){
+      if(hits > 1 && (hits-1) % 6 == 0)
+	printf("\n ");
+      printf(" 0x%08x,", (unsigned)pattern(steps, hits));
+    }
+    printf("\n");
+  }
+  printf("};\n\n");
+  printf("#endif /* _EUCLID_PATTERNS_H_ */\n");
+  return 0;
+}
@@ -0,0 +1,391 @@
+/*
+Static worst case cycle count of the interrupt handlers in the firmware.
+make isr-cycles
+or: ClockDelayIsrCycles [options] <disassembly> NAME=symbol:budget...
+  -f hz                 CPU clock, for the times in the report
+  -l symbol=n           loops in the function at symbol run at most n times
+  -i symbol=t1,t2...    possible targets of indirect calls made in symbol
+The disassembly is the output of avr-objdump -d of the ELF. Exits with 1
+if any handler can take more than its budget in cycles.
+
+Every path from the vector to its reti is followed through branches, skips,
+jumps and calls, adding the cycle count of each instruction on an ATmega328
+(taken branches and skips included), so the figure covers the compiler
+generated prologue and epilogue and everything called. It also includes the
+4 cycle interrupt response and the jmp in the vector table, but not waiting
+for another interrupt to finish. Every loop needs a bound, and is charged
+its longest iteration that many times; the result is an upper bound.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <inttypes.h>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+// interrupt response and the jmp in the vector table
+#define INTERRUPT_ENTRY_CYCLES     7
+
+struct Instruction {
+  uint32_t address;
+  uint8_t size; // bytes
+  std::string op;
+  long target; // branch, jump or call destination, -1 if none
+};
+
+struct Edge {
+  uint32_t to;
+  uint8_t extra; // cycles added when this edge is taken
+};
+
+std::map<uint32_t, Instruction> code;
+std::map<uint32_t, std::string> symbols;
+std::map<std::string, uint32_t> addresses;
+std::map<std::string, uint32_t> loopBounds;
+std::map<std::string, std::vector<std::string> > indirectTargets;
+std::map<uint32_t, uint32_t> wcetCache;
+std::set<uint32_t> analysing;
+
+void fatal(const char* format, const char* a = "", uint32_t address = 0){
+  fprintf(stderr, "ClockDelayIsrCycles: ");
+  fprintf(stderr, format, a, address);
+  fprintf(stderr, "\n");
+  exit(2);
+}
+
+std::string symbolAt(uint32_t address){
+  std::map<uint32_t, std::string>::iterator it = symbols.upper_bound(address);
+  if(it == symbols.begin())
+    return "";
+  return (--it)->second;
+}
+
+bool parse(const char* filename){
+  FILE* file = fopen(filename, "r");
+  if(file == NULL)
+    return false;
+  char line[512];
+  while(fgets(line, sizeof(line), file)){
+    unsigned long address;
+    char name[256];
+    // 00000094 <__vector_2>:
+    if(sscanf(line, "%lx <%255[^>]>:", &address, name) == 2 && line[0] != ' '){
+      symbols[address] = name;
+      addresses[name] = address;
+      continue;
+    }
+    //       94:	1f 92       	push	r1
+    char* p = line;
+    while(*p == ' ')
+      p++;
+    char* end;
+    address = strtoul(p, &end, 16);
+    if(end == p || *end != ':' || end[1] != '\t')
+      continue;
+    p = end+2;
+    Instruction in;
+    in.address = address;
+    in.size = 0;
+    while(isxdigit(p[0]) && isxdigit(p[1]) && p[2] == ' '){
+      in.size++;
+      p += 3;
+    }
+    while(*p == ' ' || *p == '\t')
+      p++;
+    char op[32];
+    if(in.size == 0 || sscanf(p, "%31s", op) != 1 || op[0] == '.')
+      continue;
+    in.op = op;
+    in.target = -1;
+    // relative targets are resolved in the comment: ; 0xd4 <__vector_2+0x40>
+    char* comment = strchr(p, ';');
+    char* hex = comment ? strstr(comment, "0x") : strstr(p, "0x");
+    if(hex && (in.op[0] == 'b' || in.op.find("jmp") != std::string::npos || in.op.find("call") != std::string::npos))
+      in.target = strtoul(hex, NULL, 16);
+    code[address] = in;
+  }
+  fclose(file);
+  return true;
+}
+
+int cycles(const std::string& op){
+  static const char* two[] = { "ld", "ldd", "st", "std", "lds", "sts", "push", "pop",
+			       "adiw", "sbiw", "mul", "muls", "mulsu", "fmul", "fmuls", "fmulsu",
+			       "cbi", "sbi", "rjmp", "ijmp", NULL };
+  static const char* three[] = { "lpm", "elpm", "jmp", "rcall", "icall", NULL };
+  static const char* four[] = { "call", "ret", "reti", NULL };
+  for(int i=0; two[i]; ++i)
+    if(op == two[i])
+      return 2;
+  for(int i=0; three[i]; ++i)
+    if(op == three[i])
+      return 3;
+  for(int i=0; four[i]; ++i)
+    if(op == four[i])
+      return 4;
+  return 1;
+}
+
+bool isBranch(const std::string& op){
+  return op.size() > 2 && op[0] == 'b' && op[1] == 'r' && op != "break";
+}
+
+bool isSkip(const std::string& op){
+  return op == "cpse" || op == "sbrc" || op == "sbrs" || op == "sbic" || op == "sbis";
+}
+
+Instruction& at(uint32_t address){
+  std::map<uint32_t, Instruction>::iterator it = code.find(address);
+  if(it == code.end())
+    fatal("no instruction at 0x%2$x, in %1$s", symbolAt(address).c_str(), address);
+  return it->second;
+}
+
+uint32_t wcet(uint32_t entry);
+
+/* cycles spent at an instruction, including any callee, and where it can go next */
+uint32_t step(Instruction& in, std::vector<Edge>& next){
+  next.clear();
+  uint32_t cost = cycles(in.op);
+  uint32_t following = in.address + in.size;
+  if(in.op == "ret" || in.op == "reti"){
+    return cost;
+  }else if(in.op == "ijmp" || in.op == "eijmp"){
+    // only the return from __prologue_saves__ is understood
+    if(symbolAt(in.address) != "__prologue_saves__")
+      fatal("indirect jump at 0x%2$x in %1$s", symbolAt(in.address).c_str(), in.address);
+    return cost;
+  }else if(in.op == "icall" || in.op == "eicall"){
+    std::string caller = symbolAt(in.address);
+    if(indirectTargets.find(caller) == indirectTargets.end())
+      fatal("indirect call at 0x%2$x in %1$s, list its targets with -i", caller.c_str(), in.address);
+    uint32_t worst = 0;
+    std::vector<std::string>& targets = indirectTargets[caller];
+    for(size_t i=0; i<targets.size(); ++i){
+      if(addresses.find(targets[i]) == addresses.end())
+	fatal("unknown indirect call target %s", targets[i].c_str());
+      worst = std::max(worst, wcet(addresses[targets[i]]));
+    }
+    cost += worst;
+  }else if(in.op == "call" || in.op == "rcall"){
+    cost += wcet(in.target);
+  }else if(in.op == "jmp" || in.op == "rjmp"){
+    // -mcall-prologues: jumps to __prologue_saves__, which returns with ijmp to the next instruction
+    if(symbolAt(in.target) == "__prologue_saves__"){
+      cost += wcet(in.target);
+    }else{
+      Edge e = { (uint32_t)in.target, 0 };
+      next.push_back(e);
+      return cost;
+    }
+  }else if(isBranch(in.op)){
+    Edge taken = { (uint32_t)in.target, 1 };
+    next.push_back(taken);
+  }else if(isSkip(in.op)){
+    Instruction& skipped = at(following);
+    Edge e = { following + skipped.size, (uint8_t)(skipped.size == 4 ? 2 : 1) };
+    next.push_back(e);
+  }
+  Edge e = { following, 0 };
+  next.push_back(e);
+  return cost;
+}
+
+struct Graph {
+  std::map<uint32_t, uint32_t> cost;
+  std::map<uint32_t, std::vector<Edge> > edges;
+  std::vector<uint32_t> order; // reverse post order, a topological order without back edges
+  std::vector<std::pair<uint32_t, Edge> > backEdges; // latch, edge to the loop header
+
+  void build(uint32_t entry){
+    std::map<uint32_t, int> state; // 1 on the depth first stack, 2 done
+    std::vector<std::pair<uint32_t, size_t> > stack;
+    visit(entry, state, stack);
+    while(!stack.empty()){
+      uint32_t n = stack.back().first;
+      size_t i = stack.back().second++;
+      std::vector<Edge>& out = edges[n];
+      if(i == out.size()){
+	state[n] = 2;
+	order.push_back(n);
+	stack.pop_back();
+      }else if(state[out[i].to] == 1){
+	backEdges.push_back(std::make_pair(n, out[i]));
+      }else if(state[out[i].to] == 0){
+	visit(out[i].to, state, stack);
+      }
+    }
+    std::reverse(order.begin(), order.end());
+  }
+
+  void visit(uint32_t n, std::map<uint32_t, int>& state, std::vector<std::pair<uint32_t, size_t> >& stack){
+    state[n] = 1;
+    cost[n] = step(at(n), edges[n]);
+    stack.push_back(std::make_pair(n, (size_t)0));
+  }
+
+  bool isBack(uint32_t from, const Edge& e){
+    for(size_t i=0; i<backEdges.size(); ++i)
+      if(backEdges[i].first == from && backEdges[i].second.to == e.to)
+	return true;
+    return false;
+  }
+
+  /* longest distance from 'from' to the start of every node reachable without back edges */
+  std::map<uint32_t, uint32_t> longest(uint32_t from){
+    std::map<uint32_t, uint32_t> dist;
+    dist[from] = 0;
+    for(size_t i=0; i<order.size(); ++i){
+      uint32_t n = order[i];
+      if(dist.find(n) == dist.end())
+	continue;
+      std::vector<Edge>& out = edges[n];
+      for(size_t j=0; j<out.size(); ++j){
+	if(isBack(n, out[j]))
+	  continue;
+	uint32_t d = dist[n] + cost[n] + out[j].extra;
+	if(dist.find(out[j].to) == dist.end() || dist[out[j].to] < d)
+	  dist[out[j].to] = d;
+      }
+    }
+    return dist;
+  }
+
+  /* nodes on some path from 'from' to 'to' without back edges */
+  std::set<uint32_t> between(uint32_t from, uint32_t to){
+    std::map<uint32_t, uint32_t> reach = longest(from);
+    std::set<uint32_t> result;
+    result.insert(to);
+    for(size_t i=order.size(); i-- > 0;){
+      uint32_t n = order[i];
+      if(reach.find(n) == reach.end())
+	continue;
+      std::vector<Edge>& out = edges[n];
+      for(size_t j=0; j<out.size(); ++j)
+	if(!isBack(n, out[j]) && result.count(out[j].to))
+	  result.insert(n);
+    }
+    return result;
+  }
+};
+
+uint32_t loopBound(uint32_t header){
+  std::string name = symbolAt(header);
+  std::map<std::string, uint32_t>::iterator it = loopBounds.find(name);
+  if(it == loopBounds.end())
+    fatal("loop at 0x%2$x in %1$s has no bound, give one with -l", name.c_str(), header);
+  return it->second;
+}
+
+/* worst case cycles from entry to its return */
+uint32_t wcet(uint32_t entry){
+  std::map<uint32_t, uint32_t>::iterator cached = wcetCache.find(entry);
+  if(cached != wcetCache.end())
+    return cached->second;
+  if(analysing.count(entry))
+    fatal("recursion through %s", symbolAt(entry).c_str());
+  analysing.insert(entry);
+
+  Graph g;
+  g.build(entry);
+  std::map<uint32_t, uint32_t> dist = g.longest(entry);
+  uint32_t worst = 0;
+  for(std::map<uint32_t, uint32_t>::iterator it = dist.begin(); it != dist.end(); ++it)
+    if(g.edges[it->first].empty())
+      worst = std::max(worst, it->second + g.cost[it->first]);
+
+  // each loop adds its longest iteration for every run beyond the one
+  // already on the path, inner loops once more per outer iteration
+  struct Loop {
+    std::set<uint32_t> body;
+    uint32_t iteration;
+    uint32_t extra;
+    bool nested;
+  };
+  std::vector<Loop> loops(g.backEdges.size());
+  for(size_t i=0; i<loops.size(); ++i){
+    uint32_t latch = g.backEdges[i].first;
+    uint32_t header = g.backEdges[i].second.to;
+    loops[i].body = g.between(header, latch);
+    loops[i].iteration = g.longest(header)[latch] + g.cost[latch] + g.backEdges[i].second.extra;
+    loops[i].nested = false;
+  }
+  std::vector<size_t> bySize;
+  for(size_t i=0; i<loops.size(); ++i)
+    bySize.push_back(i);
+  std::sort(bySize.begin(), bySize.end(), [&loops](size_t a, size_t b){
+      return loops[a].body.size() < loops[b].body.size();
+    });
+  for(size_t i=0; i<bySize.size(); ++i){
+    Loop& l = loops[bySize[i]];
+    for(size_t j=0; j<i; ++j){
+      Loop& inner = loops[bySize[j]];
+      if(!inner.nested && std::includes(l.body.begin(), l.body.end(), inner.body.begin(), inner.body.end())){
+	l.iteration += inner.extra;
+	inner.nested = true;
+      }
+    }
+    l.extra = (loopBound(g.backEdges[bySize[i]].second.to)-1)*l.iteration;
+  }
+  for(size_t i=0; i<loops.size(); ++i)
+    if(!loops[i].nested)
+      worst += loops[i].extra;
+
+  analysing.erase(entry);
+  wcetCache[entry] = worst;
+  return worst;
+}
+
+int main(int argc, char** argv){
+  double hz = 16000000;
+  int i = 1;
+  for(; i<argc && argv[i][0] == '-'; i += 2){
+    if(i+1 >= argc)
+      fatal("missing value for %s", argv[i]);
+    std::string value = argv[i+1];
+    size_t eq = value.find('=');
+    if(strcmp(argv[i], "-f") == 0){
+      hz = atof(value.c_str());
+    }else if(eq != std::string::npos && strcmp(argv[i], "-l") == 0){
+      loopBounds[value.substr(0, eq)] = strtoul(value.c_str()+eq+1, NULL, 10);
+    }else if(eq != std::string::npos && strcmp(argv[i], "-i") == 0){
+      std::vector<std::string>& targets = indirectTargets[value.substr(0, eq)];
+      for(size_t p = eq+1; p <= value.size();){
+	size_t comma = value.find(',', p);
+	if(comma == std::string::npos)
+	  comma = value.size();
+	targets.push_back(value.substr(p, comma-p));
+	p = comma+1;
+      }
+    }else{
+      fatal("bad option %s", argv[i]);
+    }
+  }
+  if(i >= argc)
+    fatal("usage: ClockDelayIsrCycles [-f hz] [-l symbol=n]... [-i symbol=targets]... disassembly NAME=symbol:budget...");
+  if(!parse(argv[i]))
+    fatal("cannot read %s", argv[i]);
+
+  int status = 0;
+  printf("%-12s %-16s %8s %8s %8s\n", "vector", "symbol", "cycles", "us", "budget");
+  for(++i; i<argc; ++i){
+    char name[64], symbol[256];
+    unsigned budget;
+    if(sscanf(argv[i], "%63[^=]=%255[^:]:%u", name, symbol, &budget) != 3)
+      fatal("bad vector %s, expected NAME=symbol:budget", argv[i]);
+    if(addresses.find(symbol) == addresses.end())
+      fatal("no symbol %s in the disassembly", symbol);
+    uint32_t worst = INTERRUPT_ENTRY_CYCLES + wcet(addresses[symbol]);
+    bool over = worst > budget;
+    printf("%-12s %-16s %8u %8.2f %8u%s\n", name, symbol, worst, worst*1e6/hz, budget,
+	   over ? "  OVER BUDGET" : "");
+    if(over)
+      status = 1;
+  }
+  return status;
+}
@@ -0,0 +1,262 @@
+/*
+Cycle accurate measurement of the compiled firmware under simavr.
+make simavr
+or: ClockDelaySimavr build/ClockDelay.elf [mcu]
+
+Loads the ELF, drives the clock (PD3), reset (PD2) and mode switch
+(PD6, PD7) inputs and the two knobs on ADC0 and ADC1, selects the serial
+only modes with commands on the UART, records every change of the outputs
+on port B, and reports the latency in CPU cycles for each output in each
+mode. A change made by the clock interrupt is timed from the clock edge,
+one made by the timer interrupt, such as a delayed pulse, from the timer
+overflow that fired it, so that the programmed delay is not counted.
+Changes made by the main loop are only counted.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sim_avr.h"
+#include "sim_elf.h"
+#include "sim_io.h"
+#include "avr_ioport.h"
+#include "avr_adc.h"
+#include "avr_uart.h"
+#include "sim_interrupts.h"
+
+#define F_CPU                 16000000
+#define VCC_MV                5000
+
+#define CLOCK_PIN             3
+#define RESET_PIN             2
+#define MODE_PIN_A            6
+#define MODE_PIN_B            7
+
+#define DIVIDE_OUTPUT_PIN     0
+#define DELAY_OUTPUT_PIN      1
+#define COMBINED_OUTPUT_PIN   2
+#define OUTPUTS               3
+
+#define INT1_VECTOR           2
+#define TIMER0_OVF_VECTOR     16
+
+#define PULSES                200
+#define CLOCK_PERIOD_US       10000
+
+#define US(us) ((avr_cycle_count_t)(us)*(F_CPU/1000000))
+
+/* what made the change: the clock interrupt, the timer interrupt or the main loop */
+enum { FROM_EDGE, FROM_TICK, FROM_LOOP, SOURCES };
+
+struct latency {
+  uint32_t count;
+  avr_cycle_count_t min;
+  avr_cycle_count_t max;
+  avr_cycle_count_t total;
+};
+
+static avr_t* avr;
+static avr_irq_t* clock_irq;
+static avr_irq_t* reset_irq;
+static avr_irq_t* mode_a_irq;
+static avr_irq_t* mode_b_irq;
+static avr_irq_t* divide_knob_irq;
+static avr_irq_t* delay_knob_irq;
+static avr_irq_t* uart_irq;
+
+static avr_cycle_count_t edge_cycle;
+static avr_cycle_count_t tick_cycle; // last timer overflow
+static int in_clock; // the clock interrupt handler is running
+static int in_timer;
+static int measuring;
+static uint8_t last_port = 0xff;
+static struct latency results[OUTPUTS][SOURCES];
+
+static void port_b_changed(struct avr_irq_t* irq, uint32_t value, void* param){
+  uint8_t changed = last_port ^ value;
+  last_port = value;
+  if(!measuring)
+    return;
+  for(int i=0; i<OUTPUTS; ++i){
+    if(changed & (1 << i)){
+      int source = in_clock ? FROM_EDGE : in_timer ? FROM_TICK : FROM_LOOP;
+      avr_cycle_count_t t = avr->cycle - (source == FROM_TICK ? tick_cycle : edge_cycle);
+      struct latency* l = &results[i][source];
+      if(l->count == 0 || t < l->min)
+	l->min = t;
+      if(t > l->max)
+	l->max = t;
+      l->total += t;
+      l->count++;
+    }
+  }
+}
+
+static void timer_pending(struct avr_irq_t* irq, uint32_t value, void* param){
+  if(value)
+    tick_cycle = avr->cycle;
+}
+
+static void clock_running(struct avr_irq_t* irq, uint32_t value, void* param){
+  in_clock = value;
+}
+
+static void timer_running(struct avr_irq_t* irq, uint32_t value, void* param){
+  in_timer = value;
+}
+
+static void run_until(avr_cycle_count_t cycle){
+  while(avr->cycle < cycle){
+    int state = avr_run(avr);
+    if(state == cpu_Done || state == cpu_Crashed){
+      fprintf(stderr, "simulation stopped at cycle %llu\n", (unsigned long long)avr->cycle);
+      exit(1);
+    }
+  }
+}
+
+/* inputs are inverted: a high input pulls the pin low */
+static void set_input(avr_irq_t* irq, int high){
+  avr_raise_irq(irq, high ? 0 : 1);
+}
+
+/* knob position 0-1, read inverted as on the hardware */
+static void set_knob(avr_irq_t* irq, float position){
+  avr_raise_irq(irq, (uint32_t)((1.0f-position)*VCC_MV));
+}
+
+/* a line of commands, given the time to arrive at 9600 baud and be applied */
+static void command(const char* line){
+  for(const char* c = line; *c; ++c)
+    avr_raise_irq(uart_irq, *c);
+  avr_raise_irq(uart_irq, '\n');
+  run_until(avr->cycle + US(2000*(strlen(line)+1) + 20000));
+}
+
+static void clock_pulses(int pulses){
+  for(int i=0; i<2*pulses; ++i){
+    edge_cycle = avr->cycle;
+    set_input(clock_irq, !(i & 1));
+    run_until(edge_cycle + US(CLOCK_PERIOD_US/2));
+  }
+  set_input(clock_irq, 0);
+}
+
+static void report(const char* name){
+  static const char* outputs[OUTPUTS] = { "divide", "delay", "combined" };
+  static const char* sources[SOURCES] = { "edge", "tick", "loop" };
+  for(int i=0; i<OUTPUTS; ++i){
+    for(int j=0; j<SOURCES; ++j){
+      struct latency* l = &results[i][j];
+      if(l->count == 0 && j != FROM_EDGE)
+	continue;
+      printf("%-8s %-9s %-4s changes %4u", name, outputs[i], sources[j], l->count);
+      if(l->count && j != FROM_LOOP)
+	printf("  min %6llu  max %6llu  mean %8.1f cycles",
+	       (unsigned long long)l->min, (unsigned long long)l->max,
+	       (double)l->total/l->count);
+      printf("\n");
+    }
+  }
+}
+
+/* clock the current settings, and report the latencies */
+static void measure(const char* name){
+  memset(results, 0, sizeof(results));
+  measuring = 1;
+  clock_pulses(PULSES);
+  // the end of pulses that outlast the clock
+  run_until(avr->cycle + US(CLOCK_PERIOD_US));
+  measuring = 0;
+  report(name);
+}
+
+/* divide and delay mode, from the switch and knobs */
+static void measure_local(const char* name, int count_mode, float divide, float delay){
+  set_input(mode_a_irq, count_mode);
+  set_input(mode_b_irq, 0);
+  set_knob(divide_knob_irq, divide);
+  set_knob(delay_knob_irq, delay);
+  // let the ADC complete a few oversampled frames and the loop pick up the settings
+  run_until(avr->cycle + US(20000));
+  measure(name);
+}
+
+/* the serial only modes, set up with a line of commands */
+static void measure_remote(const char* name, const char* line){
+  set_input(mode_a_irq, 0);
+  set_input(mode_b_irq, 0);
+  command(line);
+  measure(name);
+}
+
+int main(int argc, char** argv){
+  const char* filename = argc > 1 ? argv[1] : "build/ClockDelay.elf";
+  elf_firmware_t firmware;
+  memset(&firmware, 0, sizeof(firmware));
+  if(elf_read_firmware(filename, &firmware) != 0){
+    fprintf(stderr, "cannot read %s\n", filename);
+    return 1;
+  }
+  if(argc > 2)
+    strncpy(firmware.mmcu, argv[2], sizeof(firmware.mmcu)-1);
+  else if(firmware.mmcu[0] == '\0')
+    strcpy(firmware.mmcu, "atmega328p");
+  firmware.frequency = F_CPU;
+
+  avr = avr_make_mcu_by_name(firmware.mmcu);
+  if(avr == NULL){
+    fprintf(stderr, "unknown mcu %s\n", firmware.mmcu);
+    return 1;
+  }
+  avr_init(avr);
+  avr_load_firmware(avr, &firmware);
+  avr->frequency = F_CPU;
+  avr->vcc = avr->avcc = avr->aref = VCC_MV;
+
+  clock_irq = avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('D'), CLOCK_PIN);
+  reset_irq = avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('D'), RESET_PIN);
+  mode_a_irq = avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('D'), MODE_PIN_A);
+  mode_b_irq = avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('D'), MODE_PIN_B);
+  divide_knob_irq = avr_io_getirq(avr, AVR_IOCTL_ADC_GETIRQ, ADC_IRQ_ADC0);
+  delay_knob_irq = avr_io_getirq(avr, AVR_IOCTL_ADC_GETIRQ, ADC_IRQ_ADC1);
+  avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('B'), IOPORT_IRQ_PIN_ALL),
+			  port_b_changed, NULL);
+  avr_irq_t* clock_vector = avr_get_interrupt_irq(avr, INT1_VECTOR);
+  avr_irq_t* timer_vector = avr_get_interrupt_irq(avr, TIMER0_OVF_VECTOR);
+  avr_irq_register_notify(clock_vector + AVR_INT_IRQ_RUNNING, clock_running, NULL);
+  avr_irq_register_notify(timer_vector + AVR_INT_IRQ_PENDING, timer_pending, NULL);
+  avr_irq_register_notify(timer_vector + AVR_INT_IRQ_RUNNING, timer_running, NULL);
+
+  // commands in, and the replies kept off stdout
+  uart_irq = avr_io_getirq(avr, AVR_IOCTL_UART_GETIRQ('0'), UART_IRQ_INPUT);
+  uint32_t flags = 0;
+  avr_ioctl(avr, AVR_IOCTL_UART_SET_FLAGS('0'), &flags);
+
+  set_input(clock_irq, 0);
+  set_input(reset_irq, 0);
+
+  // boot, including the serial greeting
+  run_until(US(50000));
+
+  // shortest settings: divide by one and one tick of delay or a count of one
+  measure_local("delay", 0, 0.0f, 0.0f);
+  measure_local("count", 1, 0.0f, 0.0f);
+  // typical settings, with the delay shorter than half a clock period
+  measure_local("delay", 0, 0.25f, 0.005f);
+  measure_local("count", 1, 0.25f, 0.1f);
+
+  // the serial only modes, with pulses of 4 ticks, about 0.5ms
+  measure_remote("burst", "G4 C3 T30 M3");
+  measure_remote("euclid", "G4 D7 C2 M4");
+  measure_remote("chance", "G0 D1 C15 E7 M5");
+  measure_remote("ratio", "G0 D4 M7");
+  measure_remote("wide", "G0 C1 M8");
+  // record a loop of 8 clocks, then play it
+  command("G4 M6 A1");
+  clock_pulses(8);
+  command("A0");
+  measure("loop");
+  return 0;
+}
@@ -0,0 +1,312 @@
+#ifndef _CLOCKDELAY_SIMULATOR_H_
+#define _CLOCKDELAY_SIMULATOR_H_
+
+#include <inttypes.h>
+#include <queue>
+#include <string>
+#include <vector>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include "device.h"
+#include "adc_freerunner.h"
+#include "avrsim.h"
+#include "serial.h"
+#include <avr/eeprom.h>
+
+void setup();
+void loop();
+void reset();
+
+/**
+ * Deterministic discrete event simulation of the module in virtual time.
+ * Clock, reset, knob and switch changes and serial command lines are
+ * scheduled at nanosecond times. Timer 0 overflows at its true rate of 7812.5Hz (every 128us at
+ * 16MHz with prescaler 8), the main loop runs at a fixed interval and,
+ * if enabled, the ADC converts at 125kHz/13. Events due at the same time
+ * are handled in a fixed order: scheduled inputs, then timer, ADC and loop.
+ * Hours of clock can be simulated in seconds, since only the interrupts
+ * and the loop are executed, never the idle time in between.
+ */
+class ClockDelaySimulator {
+public:
+  typedef uint64_t Time; // nanoseconds
+
+  static const Time TIMER_PERIOD = 128000; // 256 counts at 2MHz
+  static const Time TIMER_COUNT = 500; // one Timer 0 count
+  static const Time ADC_PERIOD = 104000; // 13 ADC clocks at 125kHz
+
+  enum SwitchPosition {
+    SWITCH_DELAY = 0,
+    SWITCH_COUNT,
+    SWITCH_HOLD
+  };
+
+  /* called whenever the outputs or LEDs on port B change */
+  typedef void (*OutputCallback)(void* context, Time time, uint8_t port);
+  /* called after every simulation step, to sample inputs and firmware state */
+  typedef void (*StepCallback)(void* context, Time time);
+
+  Time loopPeriod;
+  bool adcEnabled;
+
+  ClockDelaySimulator()
+    : loopPeriod(1000000), adcEnabled(false), now(0), ticks(0),
+      nextLoop(0), nextAdc(ADC_PERIOD), sequence(0), holding(false),
+      pendingClock(false), pendingTimer(false),
+      callback(NULL), context(NULL), stepCallback(NULL), stepContext(NULL) {
+    sim_eeprom_erase(); // a new module, with no saved presets
+    serialFlush(); // and nothing left over from the last one
+    setup();
+    // all inputs low: the inputs are inverted, so the pins read high
+    PIND |= _BV(CLOCKDELAY_CLOCK_PIN) | _BV(CLOCKDELAY_RESET_PIN);
+    PIND |= _BV(MODE_SWITCH_PIN_A) | _BV(MODE_SWITCH_PIN_B);
+    for(uint8_t i=0; i<ADC_CHANNELS; ++i)
+      setAnalog(i, 0);
+    TCNT0 = 0;
+    last = PORTB;
+    // the first complete frame, which the firmware waits for at startup
+    for(uint8_t i=0; i<2*ADC_CHANNELS*ADC_OVERSAMPLING; ++i)
+      sim_adc_convert();
+    loop();
+  }
+
+  void onOutput(OutputCallback cb, void* ctx){
+    callback = cb;
+    context = ctx;
+  }
+
+  void onStep(StepCallback cb, void* ctx){
+    stepCallback = cb;
+    stepContext = ctx;
+  }
+
+  Time time(){
+    return now;
+  }
+
+  uint64_t timerTicks(){
+    return ticks;
+  }
+
+  /* a single clock edge */
+  void clock(Time at, bool high){
+    schedule(at, CLOCK_EVENT, high);
+  }
+
+  /* count clock pulses, the first rising at start */
+  void clock(Time start, Time period, Time width, uint32_t count){
+    if(count == 0)
+      return;
+    schedule(start, CLOCK_EVENT, true, period, count);
+    schedule(start+width, CLOCK_EVENT, false, period, count);
+  }
+
+  void reset(Time at, bool high){
+    schedule(at, RESET_EVENT, high);
+  }
+
+  /* knob position, 0.0 fully counter clockwise to 1.0 fully clockwise */
+  void knob(Time at, uint8_t channel, float position){
+    schedule(at, KNOB_EVENT, (ADC_VALUE_RANGE-1)*position, 0, 1, channel);
+  }
+
+  /* knob value as read by the firmware, 0 to ADC_VALUE_RANGE-1 */
+  void analog(Time at, uint8_t channel, uint16_t value){
+    schedule(at, KNOB_EVENT, value, 0, 1, channel);
+  }
+
+  void mode(Time at, SwitchPosition position){
+    schedule(at, SWITCH_EVENT, position);
+  }
+
+  /* a command line received over serial, handled by the next loop() pass */
+  void serial(Time at, const std::string& line){
+    schedule(at, SERIAL_EVENT, lines.size());
+    lines.push_back(line);
+  }
+
+  /* advance virtual time, handling everything due up to and including 'until' */
+  void run(Time until){
+    for(;;){
+      Time timer = (ticks+1)*TIMER_PERIOD;
+      Time t = timer;
+      if(adcEnabled && nextAdc < t)
+	t = nextAdc;
+      if(nextLoop < t)
+	t = nextLoop;
+      if(!events.empty() && events.top().time <= t)
+	t = events.top().time;
+      if(t > until)
+	break;
+      now = t;
+      TCNT0 = (now - ticks*TIMER_PERIOD)/TIMER_COUNT;
+      if(!events.empty() && events.top().time == now){
+	Event e = events.top();
+	events.pop();
+	handle(e);
+	if(e.count > 1){
+	  e.time += e.period;
+	  e.count--;
+	  e.sequence = sequence++;
+	  events.push(e);
+	}
+      }else if(now == timer){
+	ticks++;
+	TCNT0 = 0;
+	if(holding)
+	  pendingTimer = true;
+	else
+	  TIMER0_OVF_vect();
+      }else if(adcEnabled && now == nextAdc){
+	nextAdc += ADC_PERIOD;
+	if(!holding)
+	  sim_adc_convert();
+      }else{
+	nextLoop += loopPeriod;
+	if(!holding)
+	  loop();
+      }
+      if(PORTB != last){
+	last = PORTB;
+	if(callback != NULL)
+	  callback(context, now, last);
+      }
+      if(stepCallback != NULL)
+	stepCallback(stepContext, now);
+    }
+    now = until;
+  }
+
+  bool isPending(){
+    return !events.empty();
+  }
+
+private:
+  enum EventType {
+    CLOCK_EVENT,
+    RESET_EVENT,
+    KNOB_EVENT,
+    SWITCH_EVENT,
+    SERIAL_EVENT
+  };
+  struct Event {
+    Time time;
+    uint64_t sequence;
+    EventType type;
+    uint16_t value;
+    uint8_t channel;
+    Time period;
+    uint32_t count;
+    bool operator<(const Event& other) const {
+      // reversed, for a min-heap ordered by time then scheduling order
+      if(time != other.time)
+	return time > other.time;
+      return sequence > other.sequence;
+    }
+  };
+  std::priority_queue<Event> events;
+  std::vector<std::string> lines; // of serial events, by their value
+  Time now;
+  uint64_t ticks;
+  Time nextLoop;
+  Time nextAdc;
+  uint64_t sequence;
+  // reset input or mode switch holding the firmware in a busy loop
+  bool holding;
+  bool pendingClock;
+  bool pendingTimer;
+  uint8_t last;
+  OutputCallback callback;
+  void* context;
+  StepCallback stepCallback;
+  void* stepContext;
+
+  void schedule(Time at, EventType type, uint16_t value, Time period = 0, uint32_t count = 1, uint8_t channel = 0){
+    Event e;
+    e.time = at;
+    e.sequence = sequence++;
+    e.type = type;
+    e.value = value;
+    e.channel = channel;
+    e.period = period;
+    e.count = count;
+    events.push(e);
+  }
+
+  void setAnalog(uint8_t channel, uint16_t value){
+    // knobs are wired so that the raw reading falls as the value rises
+    uint16_t raw = ADC_VALUE_RANGE-1-value;
+    sim_adc_input[channel] = raw/ADC_OVERSAMPLING;
+    if(!adcEnabled)
+      adc_values[channel] = raw;
+  }
+
+  bool isHeld(){
+    return !(PIND & _BV(CLOCKDELAY_RESET_PIN)) ||
+      (PIND & (_BV(MODE_SWITCH_PIN_A)|_BV(MODE_SWITCH_PIN_B))) == _BV(MODE_SWITCH_PIN_A);
+  }
+
+  /* the firmware leaves its busy loop: service what was latched meanwhile */
+  void release(){
+    holding = false;
+    if(pendingClock)
+      INT1_vect();
+    if(pendingTimer)
+      TIMER0_OVF_vect();
+    pendingClock = false;
+    pendingTimer = false;
+  }
+
+  void handle(const Event& e){
+    switch(e.type){
+    case CLOCK_EVENT:
+      if(e.value)
+	PIND &= ~_BV(CLOCKDELAY_CLOCK_PIN);
+      else
+	PIND |= _BV(CLOCKDELAY_CLOCK_PIN);
+      if(holding)
+	pendingClock = true;
+      else
+	INT1_vect();
+      break;
+    case RESET_EVENT:
+      if(e.value){
+	// INT0 fires on assertion and spins until release, so run it
+	// with the pin still released and hold everything else
+	if(!holding)
+	  INT0_vect();
+	PIND &= ~_BV(CLOCKDELAY_RESET_PIN);
+	holding = true;
+      }else{
+	PIND |= _BV(CLOCKDELAY_RESET_PIN);
+	if(holding && !isHeld())
+	  release();
+      }
+      break;
+    case KNOB_EVENT:
+      setAnalog(e.channel, e.value);
+      break;
+    case SWITCH_EVENT:
+      PIND |= _BV(MODE_SWITCH_PIN_A) | _BV(MODE_SWITCH_PIN_B);
+      if(e.value == SWITCH_COUNT)
+	PIND &= ~_BV(MODE_SWITCH_PIN_A);
+      else if(e.value == SWITCH_HOLD)
+	PIND &= ~_BV(MODE_SWITCH_PIN_B);
+      if(isHeld()){
+	if(!holding && e.value == SWITCH_HOLD){
+	  // updateMode() resets and spins with interrupts disabled
+	  ::reset();
+	  holding = true;
+	}
+      }else if(holding){
+	release();
+      }
+      break;
+    case SERIAL_EVENT:
+      sim_serial_receive(lines[e.value].c_str());
+      break;
+    }
+  }
+};
+
+#endif /* _CLOCKDELAY_SIMULATOR_H_ */
@@ -0,0 +1,274 @@
+/*
+Flash and SRAM use of the firmware per symbol, against a baseline and budgets.
+make size-report
+make size-baseline    to accept the current sizes as the new baseline
+or: ClockDelaySize [options] <nm listing> [size listing]
+  -b file     compare with the baseline in file
+  -w file     write the current sizes to file as a new baseline
+  -f bytes    flash budget
+  -s bytes    SRAM budget, for static data: the stack needs the rest
+  -g bytes    flash growth budget over the baseline
+The nm listing is the output of avr-nm -S -C --size-sort of the ELF and the
+optional size listing that of avr-size -A, for section totals that include
+the vector table, startup code and padding. Exits with 1 if over budget.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <map>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#define RAM_START                  0x800000
+#define EEPROM_START               0x810000
+
+struct Symbol {
+  std::string name;
+  std::string kind;
+  long flash;
+  long sram;
+};
+
+typedef std::map<std::string, Symbol> Symbols;
+
+/*
+ * demangled C++ functions end with their parameters, and everything in
+ * flash from the library but the vector table is code
+ */
+bool isCode(const std::string& name){
+  size_t n = name.size();
+  return (name.compare(0, 2, "__") == 0 && name != "__vectors") || name == "main" ||
+    (n > 0 && name[n-1] == ')') || (n > 7 && name.compare(n-7, 7, ") const") == 0);
+}
+
+/*
+ * code, progmem, data, bss, vtable or library, from the nm type and address.
+ * nm types PROGMEM tables in the ELF as text, like code: the linker puts
+ * them after the vector table and before the startup code and all other
+ * code, so a flash symbol below the first known code, 'codeStart', is a
+ * table. C functions can't be told from tables by name.
+ */
+std::string kind(char type, unsigned long address, const std::string& name, unsigned long codeStart){
+  if(name.compare(0, 11, "vtable for ") == 0)
+    return "vtable";
+  if(name.compare(0, 2, "__") == 0 && name.compare(0, 9, "__vector_") != 0)
+    return "library";
+  if(address >= RAM_START)
+    return type == 'b' || type == 'B' ? "bss" : "data";
+  if(type == 'r' || type == 'R' || address < codeStart)
+    return "progmem";
+  return "code";
+}
+
+struct NmLine {
+  unsigned long address, size;
+  char type;
+  std::string name;
+};
+
+bool readSymbols(const char* filename, Symbols& symbols){
+  FILE* file = fopen(filename, "r");
+  if(file == NULL)
+    return false;
+  std::vector<NmLine> lines;
+  unsigned long codeStart = 0;
+  char line[1024];
+  while(fgets(line, sizeof(line), file)){
+    NmLine l;
+    int n;
+    // 00800100 00000004 B counter
+    if(sscanf(line, "%lx %lx %c %n", &l.address, &l.size, &l.type, &n) != 3)
+      continue;
+    if(l.address >= EEPROM_START)
+      continue;
+    l.name = line+n;
+    l.name.erase(l.name.find_last_not_of("\r\n")+1);
+    if(l.address < RAM_START && isCode(l.name) && (codeStart == 0 || l.address < codeStart))
+      codeStart = l.address;
+    lines.push_back(l);
+  }
+  fclose(file);
+  for(size_t i=0; i<lines.size(); ++i){
+    NmLine& l = lines[i];
+    Symbol& s = symbols[l.name];
+    s.name = l.name;
+    s.kind = kind(l.type, l.address, l.name, codeStart);
+    // initialised data is stored in flash and copied to SRAM at startup
+    s.flash += l.address < RAM_START || (l.type != 'b' && l.type != 'B') ? l.size : 0;
+    s.sram += l.address >= RAM_START ? l.size : 0;
+  }
+  return true;
+}
+
+/* flash and SRAM totals by section: .text and .data in flash, .data and .bss in SRAM */
+bool readSections(const char* filename, long& flash, long& sram){
+  FILE* file = fopen(filename, "r");
+  if(file == NULL)
+    return false;
+  char line[256];
+  flash = sram = 0;
+  while(fgets(line, sizeof(line), file)){
+    char section[64];
+    long size;
+    if(sscanf(line, "%63s %ld", section, &size) != 2)
+      continue;
+    if(strcmp(section, ".text") == 0){
+      flash += size;
+    }else if(strcmp(section, ".data") == 0){
+      flash += size;
+      sram += size;
+    }else if(strcmp(section, ".bss") == 0 || strcmp(section, ".noinit") == 0){
+      sram += size;
+    }
+  }
+  fclose(file);
+  return true;
+}
+
+/* baseline lines: flash sram kind name */
+bool readBaseline(const char* filename, Symbols& symbols){
+  FILE* file = fopen(filename, "r");
+  if(file == NULL)
+    return false;
+  char line[1024];
+  while(fgets(line, sizeof(line), file)){
+    long flash, sram;
+    char kind[32];
+    int n;
+    if(line[0] == '#' || sscanf(line, "%ld %ld %31s %n", &flash, &sram, kind, &n) != 3)
+      continue;
+    std::string name(line+n);
+    name.erase(name.find_last_not_of("\r\n")+1);
+    Symbol& s = symbols[name];
+    s.name = name;
+    s.kind = kind;
+    s.flash = flash;
+    s.sram = sram;
+  }
+  fclose(file);
+  return true;
+}
+
+bool writeBaseline(const char* filename, const std::vector<Symbol>& sorted){
+  FILE* file = fopen(filename, "w");
+  if(file == NULL)
+    return false;
+  fprintf(file, "# flash sram kind symbol, written by make size-baseline\n");
+  for(size_t i=0; i<sorted.size(); ++i)
+    fprintf(file, "%ld %ld %s %s\n", sorted[i].flash, sorted[i].sram,
+	    sorted[i].kind.c_str(), sorted[i].name.c_str());
+  return fclose(file) == 0;
+}
+
+bool larger(const Symbol& a, const Symbol& b){
+  if(a.flash + a.sram != b.flash + b.sram)
+    return a.flash + a.sram > b.flash + b.sram;
+  return a.name < b.name;
+}
+
+int main(int argc, char** argv){
+  const char* baselineFile = NULL;
+  const char* writeFile = NULL;
+  long flashBudget = 0, sramBudget = 0, growthBudget = -1;
+  int i = 1;
+  for(; i+1<argc && argv[i][0] == '-'; i += 2){
+    if(strcmp(argv[i], "-b") == 0)
+      baselineFile = argv[i+1];
+    else if(strcmp(argv[i], "-w") == 0)
+      writeFile = argv[i+1];
+    else if(strcmp(argv[i], "-f") == 0)
+      flashBudget = atol(argv[i+1]);
+    else if(strcmp(argv[i], "-s") == 0)
+      sramBudget = atol(argv[i+1]);
+    else if(strcmp(argv[i], "-g") == 0)
+      growthBudget = atol(argv[i+1]);
+    else
+      break;
+  }
+  if(i >= argc){
+    fprintf(stderr, "usage: ClockDelaySize [-b baseline] [-w baseline] [-f bytes] [-s bytes] [-g bytes] nm-listing [size-listing]\n");
+    return 2;
+  }
+  Symbols symbols;
+  if(!readSymbols(argv[i], symbols)){
+    perror(argv[i]);
+    return 2;
+  }
+  std::vector<Symbol> sorted;
+  std::map<std::string, Symbol> kinds;
+  long flash = 0, sram = 0;
+  for(Symbols::iterator it = symbols.begin(); it != symbols.end(); ++it){
+    sorted.push_back(it->second);
+    Symbol& k = kinds[it->second.kind];
+    k.flash += it->second.flash;
+    k.sram += it->second.sram;
+    flash += it->second.flash;
+    sram += it->second.sram;
+  }
+  std::sort(sorted.begin(), sorted.end(), larger);
+  if(i+1 < argc && !readSections(argv[i+1], flash, sram)){
+    perror(argv[i+1]);
+    return 2;
+  }
+
+  printf("%8s %6s  %-8s %s\n", "flash", "sram", "kind", "symbol");
+  for(size_t j=0; j<sorted.size(); ++j)
+    printf("%8ld %6ld  %-8s %s\n", sorted[j].flash, sorted[j].sram,
+	   sorted[j].kind.c_str(), sorted[j].name.c_str());
+  printf("\n");
+  for(std::map<std::string, Symbol>::iterator it = kinds.begin(); it != kinds.end(); ++it)
+    printf("%8ld %6ld  %s\n", it->second.flash, it->second.sram, it->first.c_str());
+  printf("%8ld %6ld  total\n", flash, sram);
+
+  int status = 0;
+  if(baselineFile){
+    Symbols baseline;
+    if(!readBaseline(baselineFile, baseline)){
+      printf("\nno baseline in %s, run make size-baseline\n", baselineFile);
+    }else{
+      long baseFlash = 0, baseSram = 0;
+      printf("\nchanges from %s:\n", baselineFile);
+      for(Symbols::iterator it = baseline.begin(); it != baseline.end(); ++it){
+	baseFlash += it->second.flash;
+	baseSram += it->second.sram;
+	Symbols::iterator now = symbols.find(it->first);
+	if(now == symbols.end())
+	  printf("%+8ld %+6ld  %-8s %s (removed)\n", -it->second.flash, -it->second.sram,
+		 it->second.kind.c_str(), it->first.c_str());
+	else if(now->second.flash != it->second.flash || now->second.sram != it->second.sram)
+	  printf("%+8ld %+6ld  %-8s %s\n", now->second.flash - it->second.flash,
+		 now->second.sram - it->second.sram, it->second.kind.c_str(), it->first.c_str());
+      }
+      long symbolFlash = 0, symbolSram = 0;
+      for(size_t j=0; j<sorted.size(); ++j){
+	symbolFlash += sorted[j].flash;
+	symbolSram += sorted[j].sram;
+	if(baseline.find(sorted[j].name) == baseline.end())
+	  printf("%+8ld %+6ld  %-8s %s (new)\n", sorted[j].flash, sorted[j].sram,
+		 sorted[j].kind.c_str(), sorted[j].name.c_str());
+      }
+      long growth = symbolFlash - baseFlash;
+      printf("%+8ld %+6ld  total\n", growth, symbolSram - baseSram);
+      if(growthBudget >= 0 && growth > growthBudget){
+	printf("flash grew by %ld bytes, over the budget of %ld\n", growth, growthBudget);
+	status = 1;
+      }
+    }
+  }
+  if(flashBudget && flash > flashBudget){
+    printf("flash use of %ld bytes is over the budget of %ld\n", flash, flashBudget);
+    status = 1;
+  }
+  if(sramBudget && sram > sramBudget){
+    printf("SRAM use of %ld bytes is over the budget of %ld\n", sram, sramBudget);
+    status = 1;
+  }
+  if(writeFile && !writeBaseline(writeFile, sorted)){
+    perror(writeFile);
+    return 2;
+  }
+  return status;
+}
@@ -0,0 +1,408 @@
+/*
+Exhaustive sweep of the parameter space, sharded across all cores.
+make sweep
+or: ClockDelaySweep [threads] [delay step]
+A delay step above 1 samples every n-th delay value, for a quicker run.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <avr/io.h>
+
+#include "ClockDelay.cpp"
+
+#ifndef AVRSIM_THREADS
+#error "build with -DAVRSIM_THREADS, for one simulated device per thread"
+#endif
+
+typedef std::chrono::steady_clock Clock;
+
+// every value the knob controllers can set
+#define DIVIDER_MIN                -1
+#define DIVIDER_MAX                31
+#define COUNTER_VALUES             32
+#define DELAY_VALUES               4096
+#define DIVIDER_VALUES             (DIVIDER_MAX-DIVIDER_MIN+1)
+
+// clock high time, in timer ticks
+#define WIDTH                      2
+
+#define OUTPUTS                    3
+#define MAX_REPORTED               20
+
+static const char* outputNames[OUTPUTS] = { "divide", "delay", "combined" };
+
+/* the modes swept, loop mode is left to the unit tests as it needs a recording */
+static const OperatingMode modes[] = {
+  DELAY_MODE, DIVIDE_MODE, BURST_MODE, EUCLID_MODE, CHANCE_MODE, RATIO_MODE, WIDE_MODE
+};
+#define MODES                      (sizeof(modes)/sizeof(modes[0]))
+
+static const char* modeNames[] = {
+  "disabled", "count", "delay", "burst", "euclid", "chance", "loop", "ratio", "wide"
+};
+
+/* modes that do not use the delay are run with one delay value */
+static inline uint32_t delayValues(OperatingMode m){
+  return m == DELAY_MODE || m == DIVIDE_MODE || m == BURST_MODE ? DELAY_VALUES : 1;
+}
+
+/* what one output should do during a run, times in timer ticks from the first clock rise */
+struct Expected {
+  uint32_t rises;
+  uint32_t first;
+  uint32_t width;
+  bool on; // still on at the end of the run
+};
+
+struct Observed {
+  uint32_t rises;
+  uint32_t first;
+  uint32_t lastRise;
+  uint32_t badWidth; // a completed pulse of the wrong width, 0 if none
+};
+
+struct Failure {
+  OperatingMode mode;
+  int8_t divider;
+  uint8_t counter;
+  uint16_t delay;
+  int output;
+  const char* invariant;
+  uint32_t expected;
+  uint32_t actual;
+};
+
+/* progress and failures, shared by the worker threads */
+struct Sweep {
+  std::atomic<uint32_t> nextUnit;
+  std::atomic<uint64_t> combinations;
+  std::atomic<uint64_t> failures;
+  std::vector<Failure> reported;
+  std::mutex reportLock;
+  uint16_t delayStep;
+
+  Sweep(uint16_t step) : nextUnit(0), combinations(0), failures(0), delayStep(step) {}
+
+  /* a unit of work is every delay for one mode, divider and counter */
+  static uint32_t units(){
+    return MODES*DIVIDER_VALUES*COUNTER_VALUES;
+  }
+
+  static uint64_t total(){
+    uint64_t n = 0;
+    for(size_t i=0; i<MODES; ++i)
+      n += (uint64_t)DIVIDER_VALUES*COUNTER_VALUES*delayValues(modes[i]);
+    return n;
+  }
+
+  void fail(const Failure& f){
+    if(failures++ < MAX_REPORTED){
+      std::lock_guard<std::mutex> lock(reportLock);
+      reported.push_back(f);
+    }
+  }
+};
+
+/* runs units of the sweep on this thread's simulated device */
+class Worker {
+public:
+  Worker(Sweep& s) : sweep(s) {}
+
+  void work(){
+    setup();
+    PIND |= _BV(CLOCKDELAY_CLOCK_PIN) | _BV(CLOCKDELAY_RESET_PIN);
+    PIND |= _BV(MODE_SWITCH_PIN_A) | _BV(MODE_SWITCH_PIN_B);
+    uint32_t unit;
+    while((unit = sweep.nextUnit++) < Sweep::units()){
+      OperatingMode m = modes[unit % MODES];
+      int8_t d = DIVIDER_MIN + (unit / MODES) % DIVIDER_VALUES;
+      uint8_t c = (unit / MODES) / DIVIDER_VALUES;
+      uint64_t n = 0;
+      for(uint32_t v=1; v<=delayValues(m); v+=sweep.delayStep, ++n)
+	run(m, d, c, v);
+      sweep.combinations += n;
+    }
+  }
+
+  static void start(Sweep* sweep){
+    Worker worker(*sweep);
+    worker.work();
+  }
+
+private:
+  Sweep& sweep;
+  uint8_t active;
+  uint32_t now;
+  Observed observed[OUTPUTS];
+  Expected expected[OUTPUTS];
+
+  void observe(){
+    uint8_t port = ~PORTB & (_BV(DIVIDE_OUTPUT_PIN)|_BV(DELAY_OUTPUT_PIN)|_BV(COMBINED_OUTPUT_PIN));
+    uint8_t changed = port ^ active;
+    active = port;
+    if(!changed)
+      return;
+    for(int i=0; i<OUTPUTS; ++i){
+      if(!(changed & _BV(DIVIDE_OUTPUT_PIN+i)))
+	continue;
+      Observed& o = observed[i];
+      if(port & _BV(DIVIDE_OUTPUT_PIN+i)){
+	if(o.rises++ == 0)
+	  o.first = now;
+	o.lastRise = now;
+      }else if(o.badWidth == 0 && now - o.lastRise != expected[i].width){
+	o.badWidth = now - o.lastRise;
+      }
+    }
+  }
+
+  void clock(bool high){
+    if(high)
+      PIND &= ~_BV(CLOCKDELAY_CLOCK_PIN);
+    else
+      PIND |= _BV(CLOCKDELAY_CLOCK_PIN);
+    INT1_vect();
+    observe();
+  }
+
+  void ticks(uint32_t n){
+    while(n--){
+      now++;
+      TIMER0_OVF_vect();
+      observe();
+    }
+  }
+
+  /* rises of the divider output, and whether it ends on, after 'rises' clock rises */
+  void expectDivider(int8_t d, uint32_t rises, uint32_t period){
+    Expected& e = expected[0];
+    if(d == -1){
+      e.rises = rises;
+      e.first = 0;
+      e.width = WIDTH;
+      e.on = false;
+    }else{
+      uint32_t toggles = rises/(d+1);
+      e.rises = (toggles+1)/2;
+      e.first = d*period;
+      e.width = (d+1)*period;
+      e.on = toggles & 1;
+    }
+  }
+
+  /* pulses of WIDTH on the rises where hit(i) is true, i from 1 */
+  template<class Hit>
+  void expectHits(Expected& e, uint32_t rises, uint32_t period, Hit hit){
+    e.rises = 0;
+    e.first = 0;
+    e.width = WIDTH;
+    e.on = false;
+    for(uint32_t i=1; i<=rises; ++i){
+      if(hit(i) && e.rises++ == 0)
+	e.first = (i-1)*period;
+    }
+  }
+
+  /* the clock passed through */
+  void expectClock(Expected& e, uint32_t rises){
+    e.rises = rises;
+    e.first = 0;
+    e.width = WIDTH;
+    e.on = false;
+  }
+
+  void run(OperatingMode m, int8_t d, uint8_t c, uint16_t v){
+    uint32_t period, rises;
+    uint32_t cycle = d == -1 ? 1 : d+1;
+    if(m == DELAY_MODE){
+      // the delayed pulse ends before the next rise
+      period = v + 2*WIDTH;
+      // enough for the divider output to rise and fall once
+      rises = d == -1 ? 4 : 2*(d+1)+2;
+      expectDivider(d, rises, period);
+      expected[1].rises = rises;
+      expected[1].first = v;
+      expected[1].width = WIDTH;
+      expected[1].on = false;
+      // swung on divider toggles, the clock passed through otherwise
+      expected[2].rises = rises;
+      expected[2].first = d <= 0 ? v : 0;
+      expected[2].width = WIDTH;
+      expected[2].on = false;
+    }else if(m == BURST_MODE){
+      // c+1 pulses spread over the delay, done before the next rise
+      uint32_t spacing = v/(c+1) < 2 ? 2 : v/(c+1);
+      period = (c+1)*spacing < 2*WIDTH ? 2*WIDTH : (c+1)*spacing;
+      rises = d == -1 ? 4 : 2*(d+1)+2;
+      expectDivider(d, rises, period);
+      expected[1].rises = rises*(c+1);
+      expected[1].first = 0;
+      expected[1].width = spacing/2;
+      expected[1].on = false;
+      expectClock(expected[2], rises);
+    }else if(m == EUCLID_MODE){
+      // step i of d+1 is a hit if (i*hits) mod steps < hits
+      period = 2*WIDTH;
+      rises = 2*cycle+2;
+      uint32_t steps = cycle;
+      uint32_t hits = c+1u < steps ? c+1u : steps;
+      expectDivider(d, rises, period);
+      expectHits(expected[1], rises, period, [=](uint32_t i){
+	  return (i-1) % steps * hits % steps < hits;
+	});
+      expectClock(expected[2], rises);
+    }else if(m == CHANCE_MODE){
+      // every rise, then every divider toggle, draws the next random number
+      period = 2*WIDTH;
+      rises = 2*cycle+2;
+      uint16_t threshold = c >= CHANCE_LEVELS ? 0xffff : c*(0xffff/CHANCE_LEVELS);
+      Xorshift16 random;
+      random.state = CHANCE_SEED;
+      std::vector<bool> counted(rises+1), divided(rises+1);
+      for(uint32_t i=1; i<=rises; ++i){
+	counted[i] = random.next() <= threshold;
+	divided[i] = i % cycle == 0 && random.next() <= threshold;
+      }
+      expectDivider(d, rises, period);
+      expectHits(expected[1], rises, period, [&](uint32_t i){ return counted[i]; });
+      expectHits(expected[2], rises, period, [&](uint32_t i){ return divided[i]; });
+    }else if(m == RATIO_MODE){
+      // den pulses spread over every num rises, from the first
+      uint8_t r = d < 0 ? 0 : (d+1) >> 1;
+      if(r >= RATIOS)
+	r = RATIOS-1;
+      uint32_t num = pgm_read_byte(&ratios[r][0]);
+      uint32_t den = pgm_read_byte(&ratios[r][1]);
+      period = 2*WIDTH;
+      rises = 2*(cycle > num ? cycle : num)+2;
+      expectDivider(d, rises, period);
+      expectHits(expected[1], rises, period, [=](uint32_t i){
+	  return (num-den+i*den)/num > (num-den+(i-1)*den)/num;
+	});
+      expectClock(expected[2], rises);
+    }else if(m == WIDE_MODE){
+      // one pulse every count rises, the count from the table
+      uint32_t count = pgm_read_word(&wideCounts[c < WIDE_COUNTS ? c : WIDE_COUNTS-1])+1;
+      period = 2*WIDTH;
+      rises = (2*cycle > count ? 2*cycle : count)+2;
+      expectDivider(d, rises, period);
+      expected[1].rises = rises/count;
+      expected[1].first = (count-1)*period;
+      expected[1].width = WIDTH;
+      expected[1].on = false;
+      expectClock(expected[2], rises);
+    }else{
+      period = 2*WIDTH;
+      rises = (2*cycle > 2*(c+1u) ? 2*cycle : 2*(c+1u)) + 2;
+      expectDivider(d, rises, period);
+      expected[1].rises = rises/(c+1);
+      expected[1].first = c*period;
+      expected[1].width = WIDTH;
+      expected[1].on = false;
+      // the counter is armed by a divider toggle and counts until it fires
+      bool armed = false;
+      uint32_t pos = 0, fired = 0, first = 0;
+      for(uint32_t i=1; i<=rises; ++i){
+	if(i % cycle == 0)
+	  armed = true;
+	if(armed && ++pos > c){
+	  pos = 0;
+	  if(fired++ == 0)
+	    first = (i-1)*period;
+	  armed = false;
+	}
+      }
+      expected[2].rises = fired;
+      expected[2].first = first;
+      expected[2].width = WIDTH;
+      expected[2].on = false;
+    }
+
+    cli();
+    // each run is a new clock, from the first step and its period not yet measured
+    channel.reset();
+    channel.locked = false;
+    channel.lossTicks = 0;
+    channel.mode = m;
+    channel.divider.value = d;
+    channel.counter.value = c;
+    channel.divcounter.value = c;
+    channel.delay.value = v;
+    channel.swinger.value = v;
+    channel.random.state = CHANCE_SEED;
+    sei();
+    channel.prepare(); // as the main loop does, for the modes worked out from the knobs
+    active = 0;
+    now = 0;
+    for(int i=0; i<OUTPUTS; ++i){
+      Observed& o = observed[i];
+      o.rises = o.first = o.lastRise = o.badWidth = 0;
+    }
+    for(uint32_t i=0; i<rises; ++i){
+      clock(true);
+      ticks(WIDTH);
+      clock(false);
+      ticks(period-WIDTH);
+    }
+
+    for(int i=0; i<OUTPUTS; ++i){
+      Observed& o = observed[i];
+      Expected& e = expected[i];
+      bool on = active & _BV(DIVIDE_OUTPUT_PIN+i);
+      if(o.rises != e.rises)
+	fail(m, d, c, v, i, "pulse count", e.rises, o.rises);
+      else if(o.rises && o.first != e.first)
+	fail(m, d, c, v, i, "first rise", e.first, o.first);
+      else if(o.badWidth)
+	fail(m, d, c, v, i, "pulse width", e.width, o.badWidth);
+      else if(on != e.on)
+	fail(m, d, c, v, i, "stuck output", e.on, on);
+    }
+  }
+
+  void fail(OperatingMode m, int8_t d, uint8_t c, uint16_t v, int output,
+	    const char* invariant, uint32_t wanted, uint32_t actual){
+    Failure f = { m, d, c, v, output, invariant, wanted, actual };
+    sweep.fail(f);
+  }
+};
+
+int main(int argc, char** argv){
+  unsigned threads = argc > 1 ? strtoul(argv[1], NULL, 10) : 0;
+  unsigned step = argc > 2 ? strtoul(argv[2], NULL, 10) : 1;
+  if(threads == 0)
+    threads = std::thread::hardware_concurrency();
+  if(threads == 0)
+    threads = 1;
+  if(step == 0)
+    step = 1;
+
+  Sweep sweep(step);
+  Clock::time_point start = Clock::now();
+  std::vector<std::thread> workers;
+  for(unsigned i=0; i<threads; ++i)
+    workers.push_back(std::thread(Worker::start, &sweep));
+  for(unsigned i=0; i<threads; ++i)
+    workers[i].join();
+  double seconds = std::chrono::duration<double>(Clock::now()-start).count();
+
+  for(size_t i=0; i<sweep.reported.size(); ++i){
+    Failure& f = sweep.reported[i];
+    printf("%s mode, divider %d, counter %u, delay %u: %s output %s expected %u, was %u\n",
+	   modeNames[f.mode], f.divider, f.counter, f.delay,
+	   outputNames[f.output], f.invariant, f.expected, f.actual);
+  }
+  uint64_t total = Sweep::total();
+  uint64_t done = sweep.combinations;
+  printf("%llu of %llu combinations (%.1f%%), %llu failed, %u threads, %.1fs, %.0f combinations/s\n",
+	 (unsigned long long)done, (unsigned long long)total, 100.0*done/total,
+	 (unsigned long long)sweep.failures.load(), threads, seconds, done/seconds);
+  return sweep.failures ? 1 : 0;
+}
@@ -1,17 +1,35 @@
 /*
-g++ -I../RebelTechnology/Libraries/wiring -I../RebelTechnology/Libraries/avrsim -I/opt/local/include -L/opt/local/lib -o ClockDelayTest -lboost_unit_test_framework-mt  ClockDelayTest.cpp ../RebelTechnology/Libraries/avrsim/avr/io.c ../RebelTechnology/Libraries/wiring/serial.c adc_freerunner.cpp ../RebelTechnology/Libraries/avrsim/avr/interrupt.c && ./ClockDelayTest
+Build and run on the host with the simulated registers in avrsim/:
+make test
 */
 // #define mcu atmega168
 #define BOOST_TEST_DYN_LINK
 #define BOOST_TEST_MODULE Test
 #include <boost/test/unit_test.hpp>
+#include <fstream>
+#include <sstream>
+#include <map>
+#include <vector>
+#include <algorithm>
 
 #include <avr/io.h>
+#include "avrsim.h"
+#include <avr/eeprom.h>
 
 #include "ClockDelay.cpp"
+#include "ClockDelaySimulator.h"
+#include "ClockDelayVcd.h"
+#include "ClockDelayTrace.h"
+
+/* enough conversions for a complete frame, the first is dropped */
+void adcFrame(){
+  for(int i=0; i<2*ADC_CHANNELS*ADC_OVERSAMPLING; ++i)
+    sim_adc_convert();
+}
 
 struct PinFixture {
   PinFixture() {
+    sim_eeprom_erase();
     setup();
     PIND |= _BV(PORTD2);
     PIND |= _BV(PORTD3);
@@ -19,6 +37,7 @@ struct PinFixture {
     PIND |= _BV(PORTD5);
     PIND |= _BV(PORTD6);
     PIND |= _BV(PORTD7);
+    adcFrame();
   }
 };
 
@@ -116,53 +135,53 @@ BOOST_AUTO_TEST_CASE(testDivideControlRange){
   DefaultFixture fixture;
   setDivide(0.0);
   loop();
-  BOOST_CHECK_EQUAL((int)divider.value, 0);
+  BOOST_CHECK_EQUAL((int)channel.divider.value, -1); // divide by one
   setDivide(1.0);
   loop();
-  BOOST_CHECK_EQUAL((int)divider.value, 31);
+  BOOST_CHECK_EQUAL((int)channel.divider.value, 31);
   setDivide(0.5);
   loop();
-  BOOST_CHECK_EQUAL((int)divider.value, 15);
+  BOOST_CHECK_EQUAL((int)channel.divider.value, 15);
 }
 
 BOOST_AUTO_TEST_CASE(testCounterControlRange){
   DefaultFixture fixture;
   setDelay(0.0);
   loop();
-  BOOST_CHECK_EQUAL((int)counter.value, 0);
+  BOOST_CHECK_EQUAL((int)channel.counter.value, 0);
   setDelay(1.0);
   loop();
-  BOOST_CHECK_EQUAL((int)counter.value, 31);
+  BOOST_CHECK_EQUAL((int)channel.counter.value, 31);
   setDelay(0.5);
   loop();
-  BOOST_CHECK_EQUAL((int)counter.value, 15);
+  BOOST_CHECK_EQUAL((int)channel.counter.value, 15);
 }
 
 BOOST_AUTO_TEST_CASE(testDelayControlRange){
   DefaultFixture fixture;
   setDelay(0.0);
   loop();
-  BOOST_CHECK_EQUAL(delay.value, 1);
+  BOOST_CHECK_EQUAL(channel.delay.value, 1);
   setDelay(1.0);
   loop();
-  BOOST_CHECK_EQUAL(delay.value, 4092);
+  BOOST_CHECK_EQUAL(channel.delay.value, 4093);
   setDelay(0.5);
   loop();
-  BOOST_CHECK_EQUAL(delay.value, 2046);
+  BOOST_CHECK_EQUAL(channel.delay.value, 2047);
 }
 
 BOOST_AUTO_TEST_CASE(testModes){
   DefaultFixture fixture;
   setCountMode();
   updateMode();
-  BOOST_CHECK(mode == DIVIDE_MODE);
+  BOOST_CHECK(channel.mode == DIVIDE_MODE);
   BOOST_CHECK(isCountMode());
   BOOST_CHECK(!isDelayMode());  
   setDelayMode();
   updateMode();
   BOOST_CHECK(!isCountMode());
   BOOST_CHECK(!isDelayMode());  
-  BOOST_CHECK(mode == DELAY_MODE);
+  BOOST_CHECK(channel.mode == DELAY_MODE);
 }
 
 BOOST_AUTO_TEST_CASE(testClock){
@@ -183,9 +202,9 @@ BOOST_AUTO_TEST_CASE(testDivide){
   setDelay(0.25);
   setCountMode();
   loop();
-  BOOST_CHECK_EQUAL(divider.value, 7);
+  BOOST_CHECK_EQUAL(channel.divider.value, 7);
   BOOST_CHECK(!divideIsHigh());
-  BOOST_CHECK_EQUAL(mode, DIVIDE_MODE);
+  BOOST_CHECK_EQUAL(channel.mode, DIVIDE_MODE);
   int i;
   for(i=0; !divideIsHigh(); ++i)
     toggleClock();
@@ -209,7 +228,7 @@ void checkDivide(float div){
   setDivide(div);
   loop();
 //   int pulses = div*16+1;
-  int pulses = divider.value+1;
+  int pulses = channel.divider.value+1;
   int i;
   for(i=0; !divideIsHigh() && i<100; ++i)
     pulseClock();
@@ -241,8 +260,8 @@ BOOST_AUTO_TEST_CASE(testCount){
   setDelay(0.25);
   setCountMode();
   loop();
-  BOOST_CHECK_EQUAL(counter.value, 7);
-  BOOST_CHECK_EQUAL(mode, DIVIDE_MODE);
+  BOOST_CHECK_EQUAL(channel.counter.value, 7);
+  BOOST_CHECK_EQUAL(channel.mode, DIVIDE_MODE);
   int i;
   for(i=0; !delayIsHigh() && i<1000; ++i)
     toggleClock();
@@ -265,9 +284,14 @@ BOOST_AUTO_TEST_CASE(testCountRetrigger){
   setCountMode();
   loop();
   int i;
+  // the first pulse is offset by the count, see testDivideAndCount
+  for(i=0; !combinedIsHigh() && i<1000; ++i)
+    toggleClock();
+  toggleClock();
   for(i=0; !combinedIsHigh() && i<1000; ++i)
     toggleClock();
   int period = i;
+  BOOST_CHECK_EQUAL(period, channel.divider.value*2+1);
   toggleClock();
   BOOST_CHECK(!combinedIsHigh());
   for(i=0; !combinedIsHigh() && i<period; ++i)
@@ -282,7 +306,7 @@ BOOST_AUTO_TEST_CASE(testCountRetrigger){
 void checkCount(float cnt){
   setDelay(cnt);
   loop();
-  int count = counter.value*2+1;
+  int count = channel.counter.value*2+1;
   int i;
   for(i=0; !delayIsHigh() && i<100; ++i)
     toggleClock();
@@ -307,9 +331,9 @@ BOOST_AUTO_TEST_CASE(testDelayLongPulse){
   setDelay(0.125);
   setDelayMode();
   loop();
-  BOOST_CHECK_EQUAL(delay.value, 513);
+  BOOST_CHECK_EQUAL(channel.delay.value, 513);
   BOOST_CHECK(!delayIsHigh());
-  BOOST_CHECK_EQUAL(mode, DELAY_MODE);
+  BOOST_CHECK_EQUAL(channel.mode, DELAY_MODE);
   callTimer(100);
   BOOST_CHECK(!delayIsHigh());
   int i;
@@ -371,7 +395,7 @@ BOOST_AUTO_TEST_CASE(testZeroDelay){
   setDelay(0.0);
   setDelayMode();
   loop();
-  BOOST_CHECK_EQUAL(delay.value, 1);
+  BOOST_CHECK_EQUAL(channel.delay.value, 1);
   int i;
   for(i=0; (clockIsHigh() == delayIsHigh()) && i<100; ++i){
     toggleClock();
@@ -432,39 +456,95 @@ BOOST_AUTO_TEST_CASE(testDelayShortPulse){
   setDelay(0.05);
   setDelayMode();
   loop();
-  BOOST_CHECK_EQUAL(delay.value, 205);
+  BOOST_CHECK_EQUAL(channel.delay.value, 206);
   int i;
   setClock(true);
   callTimer(100);
   setClock(false);
   for(i=0; !delayIsHigh() && i<1000; ++i)
     callTimer();
-  BOOST_CHECK_EQUAL(i, 105);
+  BOOST_CHECK_EQUAL(i, 106);
   for(i=0; delayIsHigh() && i<1000; ++i)
     callTimer();
   BOOST_CHECK_EQUAL(i, 100);
 }
 
+BOOST_AUTO_TEST_CASE(testDelayFixedGate){
+  DefaultFixture fixture;
+  setDivide(0.5);
+  setDelay(0.05);
+  setDelayMode();
+  loop();
+  channel.setGate(20);
+  int i;
+  // a trigger one tick long
+  setClock(true);
+  callTimer();
+  setClock(false);
+  for(i=0; !delayIsHigh() && i<1000; ++i)
+    callTimer();
+  BOOST_CHECK_EQUAL(i, 205);
+  for(i=0; delayIsHigh() && i<1000; ++i)
+    callTimer();
+  BOOST_CHECK_EQUAL(i, 20);
+  // a gate much longer than the delay
+  setClock(true);
+  for(i=0; !delayIsHigh() && i<1000; ++i)
+    callTimer();
+  BOOST_CHECK_EQUAL(i, 206);
+  for(i=0; delayIsHigh() && i<1000; ++i)
+    callTimer();
+  BOOST_CHECK_EQUAL(i, 20);
+  BOOST_CHECK(clockIsHigh());
+  setClock(false);
+  callTimer(1000);
+  BOOST_CHECK(!delayIsHigh());
+  channel.setGate(0);
+}
+
+BOOST_AUTO_TEST_CASE(testCountFixedGate){
+  DefaultFixture fixture;
+  setDivide(0.25);
+  setDelay(0.1);
+  setCountMode();
+  loop();
+  BOOST_CHECK_EQUAL(channel.counter.value, 3);
+  channel.setGate(5);
+  int i;
+  for(i=0; !delayIsHigh() && i<100; ++i)
+    pulseClock();
+  BOOST_CHECK_EQUAL(i, 4);
+  // held after the clock falls, for the gate length
+  BOOST_CHECK(!clockIsHigh());
+  callTimer(4);
+  BOOST_CHECK(delayIsHigh());
+  pulseClock(); // rises that do not fire leave the pulse alone
+  BOOST_CHECK(delayIsHigh());
+  callTimer();
+  BOOST_CHECK(!delayIsHigh());
+  channel.setGate(0);
+}
+
 void checkSwing(float div, float del){
   setDivide(div);
   setDelay(del);
   setDelayMode();
   loop();
-  int cycles = divider.value*2+1;
-  int time = delay.value/2+1;
-  int ticks = delay.value-time;
+  int cycles = channel.divider.value < 0 ? 1 : channel.divider.value*2+1;
+  int time = channel.delay.value/2+1;
+  int ticks = channel.delay.value-time;
   int i;
   for(i=0; clockIsHigh() == combinedIsHigh() && i<1000; ++i)
     toggleClock();
   BOOST_CHECK_EQUAL(i, cycles);
-  BOOST_CHECK(swinger.running == true);
+  BOOST_CHECK(channel.swinger.running == true);
   BOOST_CHECK(clockIsHigh());
   callTimer(time);
   setClock(false);
-  for(i=0; !combinedIsHigh() && i<1000; ++i)
+  for(i=0; !combinedIsHigh() && i<5000; ++i)
     callTimer();
   BOOST_CHECK_EQUAL(i, ticks);
-  for(i=0; combinedIsHigh() && i<1000; ++i)
+  for(i=0; combinedIsHigh() && i<5000; ++i)
     callTimer();
   BOOST_CHECK_EQUAL(i, time);
 }
@@ -487,42 +567,42 @@ BOOST_AUTO_TEST_CASE(testSwing){
   setDelay(0.2);
   setDelayMode();
   loop();
-  BOOST_CHECK_EQUAL(divider.value, 2);
-  BOOST_CHECK_EQUAL(delay.value, 205);
-  BOOST_CHECK_EQUAL(mode, DELAY_MODE);
+  BOOST_CHECK_EQUAL(channel.divider.value, 6);
+  BOOST_CHECK_EQUAL(channel.delay.value, 820);
+  BOOST_CHECK_EQUAL(channel.mode, DELAY_MODE);
   int i;
   for(i=0; clockIsHigh() == combinedIsHigh() && i<1000; ++i)
     toggleClock();
-  BOOST_CHECK_EQUAL(i, 5);
-  BOOST_CHECK(swinger.running == true);
+  BOOST_CHECK_EQUAL(i, 13);
+  BOOST_CHECK(channel.swinger.running == true);
   BOOST_CHECK(clockIsHigh());
   callTimer(80);
   setClock(false);
   for(i=0; !combinedIsHigh() && i<1000; ++i)
     callTimer();
-  BOOST_CHECK_EQUAL(i, 205-80);
+  BOOST_CHECK_EQUAL(i, 820-80);
   for(i=0; combinedIsHigh() && i<1000; ++i)
     callTimer();
   BOOST_CHECK_EQUAL(i, 80);
-  BOOST_CHECK(swinger.running == false);
+  BOOST_CHECK(channel.swinger.running == false);
   BOOST_CHECK(clockIsHigh() == false);
   BOOST_CHECK(combinedIsHigh() == false);
   BOOST_CHECK(divideIsHigh() == true);
   for(i=0; clockIsHigh() == combinedIsHigh() && i<1000; ++i)
     toggleClock();
-  BOOST_CHECK_EQUAL(i, 5);
+  BOOST_CHECK_EQUAL(i, 13);
   // repeat
   callTimer(80);
   setClock(false);
   for(i=0; !combinedIsHigh() && i<1000; ++i)
     callTimer();
-  BOOST_CHECK_EQUAL(i, 205-80);
+  BOOST_CHECK_EQUAL(i, 820-80);
   for(i=0; combinedIsHigh() && i<1000; ++i)
     callTimer();
   BOOST_CHECK_EQUAL(i, 80);
   for(i=0; clockIsHigh() == combinedIsHigh() && i<1000; ++i)
     toggleClock();
-  BOOST_CHECK_EQUAL(i, 5);
+  BOOST_CHECK_EQUAL(i, 13);
 }
 
 BOOST_AUTO_TEST_CASE(testDivideAndCount){
@@ -531,27 +611,27 @@ BOOST_AUTO_TEST_CASE(testDivideAndCount){
   setDelay(0.3);
   setCountMode();
   loop();
-  BOOST_CHECK_EQUAL(divider.value, 7);
-  BOOST_CHECK_EQUAL(divcounter.value, 4);
-  BOOST_CHECK_EQUAL(mode, DIVIDE_MODE);
+  BOOST_CHECK_EQUAL(channel.divider.value, 15);
+  BOOST_CHECK_EQUAL(channel.divcounter.value, 9);
+  BOOST_CHECK_EQUAL(channel.mode, DIVIDE_MODE);
   int i;
   for(i=0; !combinedIsHigh(); ++i)
     toggleClock();
   // the first pulse is delayed: divcounter.value*2
   // following pulses are offset with the same period as the divider: divider.value*2+1
-  BOOST_CHECK_EQUAL(i, 15+8);
+  BOOST_CHECK_EQUAL(i, 31+18);
   toggleClock();
   for(i=0; !combinedIsHigh(); ++i)
     toggleClock();
-  BOOST_CHECK_EQUAL(i, 15);
+  BOOST_CHECK_EQUAL(i, 31);
   toggleClock();
   for(i=0; !combinedIsHigh(); ++i)
     toggleClock();
-  BOOST_CHECK_EQUAL(i, 15);
+  BOOST_CHECK_EQUAL(i, 31);
   toggleClock();
   for(i=0; !combinedIsHigh(); ++i)
     toggleClock();
-  BOOST_CHECK_EQUAL(i, 15);
+  BOOST_CHECK_EQUAL(i, 31);
 }
 
 void checkDivideAndCount(float div, float cnt){
@@ -559,8 +639,8 @@ void checkDivideAndCount(float div, float cnt){
   setDelay(cnt);
   loop();
   reset();
-  int count = counter.value;
-  int pulses = divider.value;
+  int count = channel.counter.value;
+  int pulses = channel.divider.value;
   BOOST_CHECK(pulses > count/2);
   int cycles = pulses*2+count*2+1;
   int i;
@@ -581,19 +661,1057 @@ BOOST_AUTO_TEST_CASE(testDivideAndCountToAny){
     checkDivideAndCount(f, f/2);
 }
 
+/* a second channel, clocked from PD4 with its outputs on port C */
+struct SecondClockInput {
+  static bool isHigh(){
+    return !(PIND & _BV(PORTD4));
+  }
+};
+
+template<uint8_t pin>
+struct PortCOutput {
+  static bool isOff(){
+    return PINC & _BV(pin);
+  }
+  static void on(){
+    PORTC &= ~_BV(pin);
+  }
+  static void off(){
+    PORTC |= _BV(pin);
+  }
+  static void toggle(){
+    PORTC ^= _BV(pin);
+  }
+};
+
+typedef ClockChannel<SecondClockInput, PortCOutput<PORTC0>, PortCOutput<PORTC1>, PortCOutput<PORTC2> > SecondChannel;
+
+BOOST_AUTO_TEST_CASE(testIndependentChannels){
+  DefaultFixture fixture;
+  setDivide(0.5);
+  setCountMode();
+  loop();
+  SecondChannel second;
+  second.mode = DELAY_MODE;
+  second.divider.value = 1;
+  second.delay.value = 3;
+  second.swinger.value = 3;
+  second.reset();
+  uint8_t portb = PORTB;
+  // two pulses of the second clock, with one timer pass for both channels
+  for(int i=0; i<2; ++i){
+    PIND &= ~_BV(PORTD4);
+    second.rise();
+    channel.tick();
+    second.tick();
+    PIND |= _BV(PORTD4);
+    second.fall();
+    for(int t=0; t<3; ++t){
+      channel.tick();
+      second.tick();
+    }
+  }
+  BOOST_CHECK_EQUAL(PORTB, portb);
+  BOOST_CHECK_EQUAL(channel.divider.pos, 0);
+  BOOST_CHECK(!(PORTC & _BV(PORTC0))); // divided by two, on after the second rise
+  BOOST_CHECK_EQUAL(second.divider.pos, 0);
+  BOOST_CHECK(!second.delay.running);
+  // the second channel's knobs set only its own parameters
+  second.counterControl.value = -1;
+  second.counterControl.update(ADC_VALUE_RANGE-1);
+  BOOST_CHECK_EQUAL(second.counter.value, 31);
+  BOOST_CHECK_EQUAL(channel.counter.value, 0);
+  toggleClock(2);
+  BOOST_CHECK_EQUAL(channel.divider.pos, 1);
+  BOOST_CHECK_EQUAL(second.divider.pos, 0);
+}
+
 BOOST_AUTO_TEST_CASE(testDivideByOneAndCount){
   DefaultFixture fixture;
   setDivide(0.0);
   setDelay(0.5);
   setCountMode();
   loop();
-  BOOST_CHECK_EQUAL(counter.value, 7);
+  BOOST_CHECK_EQUAL(channel.counter.value, 15);
   int i;
   for(i=0; delayIsHigh() == combinedIsHigh() && i<1000; ++i)
     toggleClock();
   BOOST_CHECK_EQUAL(i, 1000);  
 }
 
+BOOST_AUTO_TEST_CASE(testAdcOversampling){
+  sim_adc_input[DIVIDE_ADC_CHANNEL] = 1000;
+  sim_adc_input[DELAY_ADC_CHANNEL] = 200;
+  // allow for the conversion pipeline settling, then a full frame
+  for(int i=0; i<2*ADC_CHANNELS*ADC_OVERSAMPLING; ++i)
+    sim_adc_convert();
+  BOOST_CHECK_EQUAL(adc_values[DIVIDE_ADC_CHANNEL], 1000*ADC_OVERSAMPLING);
+  BOOST_CHECK_EQUAL(adc_values[DELAY_ADC_CHANNEL], 200*ADC_OVERSAMPLING);
+}
+
+SerialCommandParser::Result parseCommand(const char* line, SerialCommand& cmd){
+  SerialCommandParser parser;
+  SerialCommandParser::Result result = SerialCommandParser::INCOMPLETE;
+  while(*line)
+    result = parser.receive(*line++, cmd);
+  return result;
+}
+
+BOOST_AUTO_TEST_CASE(testSerialCommandParse){
+  SerialCommand cmd;
+  BOOST_CHECK_EQUAL(parseCommand("D7 C3 T205 M1 P16 S3\n", cmd), SerialCommandParser::COMPLETE);
+  BOOST_CHECK_EQUAL(cmd.flags, COMMAND_DIVIDER|COMMAND_COUNTER|COMMAND_DELAY|COMMAND_MODE|COMMAND_PULSES|COMMAND_STATUS);
+  BOOST_CHECK_EQUAL(cmd.divider, 7);
+  BOOST_CHECK_EQUAL(cmd.counter, 3);
+  BOOST_CHECK_EQUAL(cmd.delay, 205);
+  BOOST_CHECK_EQUAL(cmd.mode, 1);
+  BOOST_CHECK_EQUAL(cmd.pulses, 16);
+  BOOST_CHECK_EQUAL(cmd.status, 3);
+  BOOST_CHECK_EQUAL(parseCommand("D-1 R P S\r", cmd), SerialCommandParser::COMPLETE);
+  BOOST_CHECK_EQUAL(cmd.flags, COMMAND_DIVIDER|COMMAND_RESET|COMMAND_PULSES|COMMAND_STATUS);
+  BOOST_CHECK_EQUAL(cmd.divider, -1);
+  BOOST_CHECK_EQUAL(cmd.pulses, 1);
+  BOOST_CHECK_EQUAL(cmd.status, STATUS_ALL);
+  BOOST_CHECK_EQUAL(parseCommand("W8\n", cmd), SerialCommandParser::COMPLETE);
+  BOOST_CHECK_EQUAL(cmd.flags, COMMAND_WATCHDOG);
+  BOOST_CHECK_EQUAL(cmd.lossPeriods, 8);
+  BOOST_CHECK_EQUAL(parseCommand("G500\n", cmd), SerialCommandParser::COMPLETE);
+  BOOST_CHECK_EQUAL(cmd.flags, COMMAND_GATE);
+  BOOST_CHECK_EQUAL(cmd.gate, 500);
+  BOOST_CHECK_EQUAL(parseCommand("E77\n", cmd), SerialCommandParser::COMPLETE);
+  BOOST_CHECK_EQUAL(cmd.flags, COMMAND_SEED);
+  BOOST_CHECK_EQUAL(cmd.seed, 77);
+  BOOST_CHECK_EQUAL(parseCommand("A1\n", cmd), SerialCommandParser::COMPLETE);
+  BOOST_CHECK_EQUAL(cmd.flags, COMMAND_LOOP);
+  BOOST_CHECK_EQUAL(cmd.loop, 1);
+  BOOST_CHECK_EQUAL(parseCommand("D7", cmd), SerialCommandParser::INCOMPLETE);
+}
+
+BOOST_AUTO_TEST_CASE(testSerialCommandMalformed){
+  SerialCommand cmd;
+  BOOST_CHECK_EQUAL(parseCommand("D7 X\n", cmd), SerialCommandParser::MALFORMED);
+  BOOST_CHECK_EQUAL(parseCommand("D128\n", cmd), SerialCommandParser::MALFORMED);
+  BOOST_CHECK_EQUAL(parseCommand("T0\n", cmd), SerialCommandParser::MALFORMED);
+  BOOST_CHECK_EQUAL(parseCommand("C\n", cmd), SerialCommandParser::MALFORMED);
+  BOOST_CHECK_EQUAL(parseCommand("D7C3\n", cmd), SerialCommandParser::MALFORMED);
+  BOOST_CHECK_EQUAL(parseCommand("W256\n", cmd), SerialCommandParser::MALFORMED);
+  BOOST_CHECK_EQUAL(parseCommand("G65536\n", cmd), SerialCommandParser::MALFORMED);
+  BOOST_CHECK_EQUAL(parseCommand("E0\n", cmd), SerialCommandParser::MALFORMED);
+  BOOST_CHECK_EQUAL(parseCommand("A2\n", cmd), SerialCommandParser::MALFORMED);
+  BOOST_CHECK_EQUAL(parseCommand("P1 P1 P1 P1 P1 P1 P1 P1 P1 P1 P1 P1\n", cmd), SerialCommandParser::MALFORMED);
+  BOOST_CHECK_EQUAL(parseCommand("P256\n", cmd), SerialCommandParser::COMPLETE);
+  BOOST_CHECK_EQUAL(cmd.pulses, COMMAND_MAX_PULSES);
+  BOOST_CHECK_EQUAL(parseCommand("P257\n", cmd), SerialCommandParser::MALFORMED);
+}
+
+BOOST_AUTO_TEST_CASE(testSerialCommandApply){
+  DefaultFixture fixture;
+  setDivide(0.5);
+  setDelayMode();
+  loop();
+  SerialCommand cmd;
+  BOOST_CHECK_EQUAL(parseCommand("D3 T99 M1 R P8\n", cmd), SerialCommandParser::COMPLETE);
+  BOOST_CHECK(applyCommand(cmd));
+  BOOST_CHECK_EQUAL(channel.divider.value, 3);
+  BOOST_CHECK_EQUAL(channel.delay.value, 99);
+  BOOST_CHECK_EQUAL(channel.mode, DIVIDE_MODE);
+  BOOST_CHECK_EQUAL(channel.divider.pos, 0);
+  BOOST_CHECK(!divideIsHigh());
+  BOOST_CHECK(!clockIsHigh());
+  loop(); // knobs and switch must not override remote settings
+  BOOST_CHECK_EQUAL(channel.divider.value, 3);
+  BOOST_CHECK_EQUAL(channel.delay.value, 99);
+  BOOST_CHECK_EQUAL(channel.mode, DIVIDE_MODE);
+  BOOST_CHECK_EQUAL(parseCommand("P4\n", cmd), SerialCommandParser::COMPLETE);
+  BOOST_CHECK(applyCommand(cmd));
+  BOOST_CHECK(divideIsHigh());
+  BOOST_CHECK(interruptsEnabled()); // pulses are injected with interrupts enabled
+  BOOST_CHECK_EQUAL(parseCommand("M200 D5\n", cmd), SerialCommandParser::COMPLETE);
+  BOOST_CHECK(!applyCommand(cmd));
+  BOOST_CHECK_EQUAL(channel.divider.value, 3);
+  BOOST_CHECK_EQUAL(parseCommand("L\n", cmd), SerialCommandParser::COMPLETE);
+  BOOST_CHECK(applyCommand(cmd));
+  loop();
+  BOOST_CHECK_EQUAL(channel.divider.value, 15);
+  BOOST_CHECK_EQUAL(channel.mode, DELAY_MODE);
+}
+
+BOOST_AUTO_TEST_CASE(testBurst){
+  DefaultFixture fixture;
+  SerialCommand cmd;
+  BOOST_CHECK_EQUAL(parseCommand("M3 C3 T100\n", cmd), SerialCommandParser::COMPLETE);
+  BOOST_CHECK(applyCommand(cmd));
+  // four pulses 25 ticks apart, each on for 12 ticks, from the rise
+  pulseClock();
+  int rises = 0, i;
+  bool on = false;
+  for(i=0; i<200; ++i){
+    if(delayIsHigh() && !on){
+      BOOST_CHECK_EQUAL(i % 25, 0);
+      rises++;
+    }
+    if(!delayIsHigh() && on)
+      BOOST_CHECK_EQUAL(i % 25, 12);
+    on = delayIsHigh();
+    callTimer();
+  }
+  BOOST_CHECK_EQUAL(rises, 4);
+  BOOST_CHECK(!channel.burst.running);
+  // a rise during a burst starts a new one
+  pulseClock();
+  callTimer(60);
+  BOOST_CHECK_EQUAL(channel.burst.left, 1);
+  pulseClock();
+  BOOST_CHECK(delayIsHigh());
+  BOOST_CHECK_EQUAL(channel.burst.left, 3);
+  // with a gate the pulses are of fixed width
+  channel.setGate(3);
+  pulseClock();
+  callTimer(3);
+  BOOST_CHECK(!delayIsHigh());
+  callTimer(22);
+  BOOST_CHECK(delayIsHigh());
+  channel.setGate(0);
+  BOOST_CHECK_EQUAL(parseCommand("L\n", cmd), SerialCommandParser::COMPLETE);
+  BOOST_CHECK(applyCommand(cmd));
+}
+
+BOOST_AUTO_TEST_CASE(testEuclidPatterns){
+  for(uint8_t steps=1; steps<=EUCLID_MAX_STEPS; ++steps){
+    for(uint8_t hits=1; hits<=steps; ++hits){
+      uint32_t p = pgm_read_dword(euclidPatterns+EUCLID_INDEX(steps, hits));
+      BOOST_CHECK_EQUAL(__builtin_popcount(p), hits);
+      BOOST_CHECK(p & 1);
+      BOOST_CHECK_EQUAL(p >> 1 >> (steps-1), 0);
+    }
+  }
+  BOOST_CHECK_EQUAL(pgm_read_dword(euclidPatterns+EUCLID_INDEX(8, 3)), 0x49); // x..x..x.
+}
+
+BOOST_AUTO_TEST_CASE(testEuclid){
+  DefaultFixture fixture;
+  SerialCommand cmd;
+  BOOST_CHECK_EQUAL(parseCommand("M4 D7 C2 R\n", cmd), SerialCommandParser::COMPLETE);
+  BOOST_CHECK(applyCommand(cmd));
+  loop();
+  std::string hits;
+  for(int i=0; i<16; ++i){
+    setClock(true);
+    hits += delayIsHigh() ? 'x' : '.';
+    setClock(false);
+    BOOST_CHECK(!delayIsHigh());
+  }
+  BOOST_CHECK_EQUAL(hits, "x..x..x.x..x..x.");
+  // a new pattern starts with the next cycle
+  toggleClock(4);
+  BOOST_CHECK_EQUAL(parseCommand("C4\n", cmd), SerialCommandParser::COMPLETE);
+  BOOST_CHECK(applyCommand(cmd));
+  loop();
+  hits.clear();
+  for(int i=0; i<14; ++i){
+    setClock(true);
+    hits += delayIsHigh() ? 'x' : '.';
+    setClock(false);
+  }
+  BOOST_CHECK_EQUAL(hits, ".x..x.x.x.xx.x");
+  BOOST_CHECK_EQUAL(parseCommand("L\n", cmd), SerialCommandParser::COMPLETE);
+  BOOST_CHECK(applyCommand(cmd));
+}
+
+BOOST_AUTO_TEST_CASE(testChance){
+  DefaultFixture fixture;
+  SerialCommand cmd;
+  BOOST_CHECK_EQUAL(parseCommand("M5 D1 C31 R\n", cmd), SerialCommandParser::COMPLETE);
+  BOOST_CHECK(applyCommand(cmd));
+  loop();
+  int passed = 0, divided = 0;
+  for(int i=0; i<100; ++i){
+    setClock(true);
+    passed += delayIsHigh();
+    divided += combinedIsHigh();
+    setClock(false);
+  }
+  BOOST_CHECK_EQUAL(passed, 100);
+  BOOST_CHECK_EQUAL(divided, 50);
+  BOOST_CHECK_EQUAL(parseCommand("C0\n", cmd), SerialCommandParser::COMPLETE);
+  BOOST_CHECK(applyCommand(cmd));
+  loop();
+  for(int i=0; i<100; ++i){
+    setClock(true);
+    BOOST_CHECK(!delayIsHigh());
+    BOOST_CHECK(!combinedIsHigh());
+    setClock(false);
+  }
+  // about half, and the same pulses again after the same seed
+  BOOST_CHECK_EQUAL(parseCommand("C15 E1234\n", cmd), SerialCommandParser::COMPLETE);
+  BOOST_CHECK(applyCommand(cmd));
+  loop();
+  std::string first;
+  for(int i=0; i<1000; ++i){
+    setClock(true);
+    first += delayIsHigh() ? 'x' : '.';
+    setClock(false);
+  }
+  passed = std::count(first.begin(), first.end(), 'x');
+  BOOST_CHECK(passed > 400 && passed < 560);
+  BOOST_CHECK_EQUAL(parseCommand("E1234\n", cmd), SerialCommandParser::COMPLETE);
+  BOOST_CHECK(applyCommand(cmd));
+  std::string second;
+  for(int i=0; i<1000; ++i){
+    setClock(true);
+    second += delayIsHigh() ? 'x' : '.';
+    setClock(false);
+  }
+  BOOST_CHECK_EQUAL(first, second);
+  BOOST_CHECK_EQUAL(parseCommand("L\n", cmd), SerialCommandParser::COMPLETE);
+  BOOST_CHECK(applyCommand(cmd));
+}
+
+BOOST_AUTO_TEST_CASE(testIntervalRing){
+  IntervalRing ring;
+  ring.clear();
+  static const uint16_t intervals[] = { 163, 163, 164, 100, 65535, 1, 0, 8192, 163 };
+  uint16_t n = sizeof(intervals)/sizeof(intervals[0]);
+  for(uint16_t i=0; i<n; ++i)
+    BOOST_CHECK(ring.write(intervals[i]));
+  // 1 byte for each small change, modulo 2^16: 65535 to 1 is +2
+  BOOST_CHECK_EQUAL(ring.length, 2+1+1+1+2+1+1+3+2);
+  ring.rewind();
+  for(uint16_t j=0; j<2; ++j)
+    for(uint16_t i=0; i<n; ++i)
+      BOOST_CHECK_EQUAL(ring.next(), intervals[i]);
+  // a steady clock takes one byte per onset after the first
+  ring.clear();
+  uint16_t count = 0;
+  while(ring.write(163))
+    count++;
+  BOOST_CHECK_EQUAL(count, INTERVAL_RING_SIZE-1);
+}
+
+BOOST_AUTO_TEST_CASE(testLooper){
+  DefaultFixture fixture;
+  SerialCommand cmd;
+  BOOST_CHECK_EQUAL(parseCommand("M6 A1\n", cmd), SerialCommandParser::COMPLETE);
+  BOOST_CHECK(applyCommand(cmd));
+  callTimer(7); // nothing is recorded before the first rise
+  static const int rhythm[] = { 10, 20, 5 };
+  for(int i=0; i<3; ++i){
+    pulseClock();
+    callTimer(rhythm[i]);
+  }
+  pulseClock();
+  callTimer(15);
+  BOOST_CHECK_EQUAL(channel.looper.state, LOOPER_RECORDING);
+  BOOST_CHECK_EQUAL(parseCommand("A0\n", cmd), SerialCommandParser::COMPLETE);
+  BOOST_CHECK(applyCommand(cmd));
+  BOOST_CHECK_EQUAL(channel.looper.state, LOOPER_PLAYING);
+  BOOST_CHECK_EQUAL(channel.looper.ring.length, 4);
+  // played twice over, with no clock
+  std::vector<int> onsets;
+  bool on = false;
+  for(int t=1; t<=100; ++t){
+    callTimer();
+    if(delayIsHigh() && !on)
+      onsets.push_back(t);
+    on = delayIsHigh();
+  }
+  static const int expected[] = { 1, 11, 31, 36, 51, 61, 81, 86 };
+  BOOST_CHECK_EQUAL_COLLECTIONS(onsets.begin(), onsets.end(), expected, expected+8);
+  // clock pulses are ignored, a reset starts the loop again
+  callTimer(25);
+  pulseClock();
+  BOOST_CHECK(!delayIsHigh());
+  BOOST_CHECK_EQUAL(parseCommand("R\n", cmd), SerialCommandParser::COMPLETE);
+  BOOST_CHECK(applyCommand(cmd));
+  BOOST_CHECK(!delayIsHigh());
+  callTimer();
+  BOOST_CHECK(delayIsHigh());
+  callTimer(5);
+  BOOST_CHECK(!delayIsHigh());
+  callTimer(5);
+  BOOST_CHECK(delayIsHigh());
+  // leaving loop mode ends the pulse being played, coming back plays on
+  BOOST_CHECK_EQUAL(parseCommand("M1\n", cmd), SerialCommandParser::COMPLETE);
+  BOOST_CHECK(applyCommand(cmd));
+  BOOST_CHECK(!delayIsHigh());
+  callTimer(100);
+  BOOST_CHECK(!delayIsHigh());
+  BOOST_CHECK_EQUAL(parseCommand("M6\n", cmd), SerialCommandParser::COMPLETE);
+  BOOST_CHECK(applyCommand(cmd));
+  callTimer(20);
+  BOOST_CHECK(delayIsHigh());
+  // and so does returning to the switch
+  BOOST_CHECK_EQUAL(parseCommand("L\n", cmd), SerialCommandParser::COMPLETE);
+  BOOST_CHECK(applyCommand(cmd));
+  loop();
+  BOOST_CHECK_EQUAL(channel.mode, DELAY_MODE);
+  BOOST_CHECK(!delayIsHigh());
+  BOOST_CHECK_EQUAL(parseCommand("L R\n", cmd), SerialCommandParser::COMPLETE);
+  BOOST_CHECK(applyCommand(cmd));
+  loop();
+  callTimer(100);
+  BOOST_CHECK(!delayIsHigh());
+}
+
+std::string ratioPulses(int clocks){
+  std::string pulses;
+  for(int i=0; i<clocks; ++i){
+    setClock(true);
+    pulses += delayIsHigh() ? 'x' : '.';
+    setClock(false);
+  }
+  return pulses;
+}
+
+BOOST_AUTO_TEST_CASE(testRatio){
+  DefaultFixture fixture;
+  SerialCommand cmd;
+  BOOST_CHECK_EQUAL(parseCommand("M7 D5 R\n", cmd), SerialCommandParser::COMPLETE);
+  BOOST_CHECK(applyCommand(cmd));
+  loop();
+  BOOST_CHECK_EQUAL(channel.ratio.num, 3);
+  BOOST_CHECK_EQUAL(channel.ratio.den, 2);
+  std::string pulses = ratioPulses(3000);
+  BOOST_CHECK_EQUAL(pulses.substr(0, 6), "x.xx.x");
+  // two in every three clocks, with no drift
+  BOOST_CHECK_EQUAL(std::count(pulses.begin(), pulses.end(), 'x'), 2000);
+  BOOST_CHECK_EQUAL(pulses.substr(2994), "x.xx.x");
+  // a new ratio starts on the next clock
+  BOOST_CHECK_EQUAL(parseCommand("D1\n", cmd), SerialCommandParser::COMPLETE);
+  BOOST_CHECK(applyCommand(cmd));
+  loop();
+  BOOST_CHECK_EQUAL(ratioPulses(10), "x.xxxx.xxx");
+  BOOST_CHECK_EQUAL(parseCommand("D31\n", cmd), SerialCommandParser::COMPLETE);
+  BOOST_CHECK(applyCommand(cmd));
+  loop();
+  BOOST_CHECK_EQUAL(ratioPulses(16), "x.......x.......");
+  BOOST_CHECK_EQUAL(parseCommand("L\n", cmd), SerialCommandParser::COMPLETE);
+  BOOST_CHECK(applyCommand(cmd));
+}
+
+BOOST_AUTO_TEST_CASE(testWideCount){
+  DefaultFixture fixture;
+  SerialCommand cmd;
+  // a bar of 4/4 at 24 PPQN
+  BOOST_CHECK_EQUAL(parseCommand("M8 C12 R\n", cmd), SerialCommandParser::COMPLETE);
+  BOOST_CHECK(applyCommand(cmd));
+  loop();
+  BOOST_CHECK_EQUAL(channel.widecounter.value, 95);
+  int fired = 0;
+  for(int i=1; i<=3*96; ++i){
+    setClock(true);
+    if(delayIsHigh()){
+      BOOST_CHECK_EQUAL(i % 96, 0);
+      fired++;
+    }
+    setClock(false);
+  }
+  BOOST_CHECK_EQUAL(fired, 3);
+  // the knob at full scale counts to 65536
+  BOOST_CHECK_EQUAL(parseCommand("L M8 R\n", cmd), SerialCommandParser::COMPLETE);
+  BOOST_CHECK(applyCommand(cmd));
+  setDelay(1.0);
+  loop();
+  BOOST_CHECK_EQUAL(channel.widecounter.value, 65535);
+  pulseClock(65535);
+  BOOST_CHECK_EQUAL(channel.widecounter.pos, 65535);
+  setClock(true);
+  BOOST_CHECK(delayIsHigh());
+  BOOST_CHECK_EQUAL(channel.widecounter.pos, 0);
+  setClock(false);
+  BOOST_CHECK_EQUAL(parseCommand("L\n", cmd), SerialCommandParser::COMPLETE);
+  BOOST_CHECK(applyCommand(cmd));
+}
+
+BOOST_AUTO_TEST_CASE(testStartupGatedOnFirstAdcFrame){
+  sim_eeprom_erase();
+  setup();
+  PIND |= _BV(PORTD2) | _BV(PORTD3) | _BV(PORTD6) | _BV(PORTD7);
+  BOOST_CHECK_EQUAL(EIMSK, 0);
+  uint8_t outputs = _BV(PORTB0) | _BV(PORTB1) | _BV(PORTB2);
+  // conversions every 104us, timer overflows every 128us, a running clock
+  // at the input and the loop polled in between, in 8us steps
+  int spurious = 0;
+  for(int t=8; t<=5000 && !started; t+=8){
+    if(t % 104 == 0)
+      sim_adc_convert();
+    if(t % 128 == 0)
+      TIMER0_OVF_vect();
+    if(t % 200 == 0){
+      PIND ^= _BV(PORTD3);
+      if(EIMSK & _BV(INT1))
+	INT1_vect();
+    }
+    loop();
+    if((PORTB & outputs) != outputs)
+      spurious++;
+  }
+  BOOST_CHECK(started);
+  BOOST_CHECK_EQUAL(spurious, 0);
+  BOOST_CHECK_EQUAL(EIMSK, _BV(INT0) | _BV(INT1));
+  // 16 conversions, the first frame is dropped
+  BOOST_CHECK_EQUAL(readyTicks, 16*104/128);
+  sim_serial_clear();
+  sim_serial_receive("S1024\n");
+  loop();
+  BOOST_CHECK_EQUAL(sim_serial_output(), "ok ready 13 ticks\n");
+  // the line ends when nothing was reported on it
+  sim_serial_clear();
+  sim_serial_receive("S0\n");
+  loop();
+  BOOST_CHECK_EQUAL(sim_serial_output(), "ok \n");
+}
+
+/* apply a command, and run the loop until the preset it changes has been written */
+void writePreset(const char* command){
+  SerialCommand cmd;
+  BOOST_REQUIRE_EQUAL(parseCommand(command, cmd), SerialCommandParser::COMPLETE);
+  BOOST_REQUIRE(applyCommand(cmd));
+  loop();
+  callTimer(PRESET_HOLDOFF_TICKS);
+  for(size_t i=0; i<=sizeof(PresetRecord); ++i)
+    loop();
+}
+
+BOOST_AUTO_TEST_CASE(testPresetRestoredAtBoot){
+  DefaultFixture fixture;
+  setDivide(0.5);
+  loop();
+  SerialCommand cmd;
+  BOOST_CHECK_EQUAL(parseCommand("D3 C5 T99 M1\n", cmd), SerialCommandParser::COMPLETE);
+  BOOST_CHECK(applyCommand(cmd));
+  loop();
+  callTimer(PRESET_HOLDOFF_TICKS-1);
+  loop();
+  BOOST_CHECK(presets.isPending());
+  BOOST_CHECK_EQUAL(sim_eeprom_writes, 0);
+  callTimer();
+  for(size_t i=0; i<=sizeof(PresetRecord); ++i)
+    loop();
+  BOOST_CHECK(!presets.isPending());
+  // power cycle
+  remoteControl = 0;
+  channel.divider.value = 0;
+  channel.counter.value = 0;
+  channel.delay.value = 0;
+  channel.mode = DISABLED_MODE;
+  setup();
+  adcFrame();
+  BOOST_CHECK_EQUAL(remoteControl, COMMAND_DIVIDER|COMMAND_COUNTER|COMMAND_DELAY|COMMAND_MODE);
+  loop(); // knobs and switch must not override restored settings
+  BOOST_CHECK_EQUAL(channel.divider.value, 3);
+  BOOST_CHECK_EQUAL(channel.divcounter.value, 5);
+  BOOST_CHECK_EQUAL(channel.swinger.value, 99);
+  BOOST_CHECK_EQUAL(channel.mode, DIVIDE_MODE);
+  BOOST_CHECK(!presets.isPending());
+  // back to local control is kept too
+  writePreset("L\n");
+  setup();
+  adcFrame();
+  setDivide(0.5);
+  loop();
+  BOOST_CHECK_EQUAL(remoteControl, 0);
+  BOOST_CHECK_EQUAL(channel.divider.value, 15);
+}
+
+BOOST_AUTO_TEST_CASE(testPresetWritesCoalesced){
+  DefaultFixture fixture;
+  SerialCommand cmd;
+  for(int d=0; d<10; ++d){
+    std::ostringstream command;
+    command << "D" << d << "\n";
+    BOOST_CHECK_EQUAL(parseCommand(command.str().c_str(), cmd), SerialCommandParser::COMPLETE);
+    BOOST_CHECK(applyCommand(cmd));
+    loop();
+    callTimer(PRESET_HOLDOFF_TICKS/2);
+    loop();
+  }
+  BOOST_CHECK_EQUAL(sim_eeprom_writes, 0);
+  callTimer(PRESET_HOLDOFF_TICKS/2);
+  for(size_t i=0; i<=2*sizeof(PresetRecord); ++i)
+    loop();
+  // one record, in the first slot
+  BOOST_CHECK(sim_eeprom_writes <= sizeof(PresetRecord));
+  BOOST_CHECK_EQUAL(sim_eeprom[sizeof(PresetRecord)], 0xff);
+  Preset p;
+  PresetStore store;
+  BOOST_CHECK(store.restore(p));
+  BOOST_CHECK_EQUAL(p.divider, 9);
+  BOOST_CHECK_EQUAL(parseCommand("L\n", cmd), SerialCommandParser::COMPLETE);
+  BOOST_CHECK(applyCommand(cmd));
+}
+
+BOOST_AUTO_TEST_CASE(testPresetWearLevelling){
+  DefaultFixture fixture;
+  Preset p;
+  PresetStore store;
+  BOOST_CHECK(!store.restore(p));
+  // twice round the ring, the sequence number wrapping too
+  for(unsigned i=0; i<2*PRESET_SLOTS; ++i){
+    std::ostringstream command;
+    command << "T" << i+1 << "\n";
+    writePreset(command.str().c_str());
+    BOOST_CHECK(store.restore(p));
+    BOOST_CHECK_EQUAL(p.delay, i+1);
+  }
+  // each slot written twice
+  BOOST_CHECK(sim_eeprom_writes <= 2*PRESET_SLOTS*sizeof(PresetRecord));
+  // a record cut short falls back to the one before
+  int newest = (2*PRESET_SLOTS-1) % PRESET_SLOTS;
+  sim_eeprom[newest*sizeof(PresetRecord)+offsetof(PresetRecord, preset)] ^= 1;
+  BOOST_CHECK(store.restore(p));
+  BOOST_CHECK_EQUAL(p.delay, 2*PRESET_SLOTS-1);
+  setup();
+  adcFrame();
+  BOOST_CHECK_EQUAL(channel.delay.value, 2*PRESET_SLOTS-1);
+  SerialCommand cmd;
+  BOOST_CHECK_EQUAL(parseCommand("L\n", cmd), SerialCommandParser::COMPLETE);
+  BOOST_CHECK(applyCommand(cmd));
+}
+
+#ifdef EVENT_TRACE
+BOOST_AUTO_TEST_CASE(testEventTrace){
+  DefaultFixture fixture;
+  setDivide(0.0);
+  setCountMode();
+  loop();
+  eventTrace.clear();
+  pulseClock();
+  callTimer(3);
+  pulseClock();
+  BOOST_CHECK_EQUAL(eventTrace.size(), 4);
+  BOOST_CHECK_EQUAL(eventTrace.get(0).state >> EVENT_TRACE_TYPE_SHIFT, EVENT_TRACE_RISE);
+  BOOST_CHECK_EQUAL(eventTrace.get(1).state >> EVENT_TRACE_TYPE_SHIFT, EVENT_TRACE_FALL);
+  BOOST_CHECK_EQUAL(eventTrace.get(2).state >> EVENT_TRACE_TYPE_SHIFT, EVENT_TRACE_RISE);
+  BOOST_CHECK_EQUAL(eventTrace.get(2).time - eventTrace.get(1).time, 3);
+  BOOST_CHECK_EQUAL(eventTrace.get(2).time, ticks()); // the same counter as the boot timing
+  BOOST_CHECK_EQUAL(eventTrace.get(3).state & EVENT_TRACE_PORT_MASK, PORTB & EVENT_TRACE_PORT_MASK);
+  SerialCommand cmd;
+  BOOST_CHECK_EQUAL(parseCommand("F\n", cmd), SerialCommandParser::COMPLETE);
+  BOOST_CHECK(applyCommand(cmd));
+  pulseClock(10);
+  BOOST_CHECK_EQUAL(eventTrace.size(), 4);
+  BOOST_CHECK_EQUAL(parseCommand("Z64\n", cmd), SerialCommandParser::COMPLETE);
+  BOOST_CHECK(applyCommand(cmd));
+  BOOST_CHECK_EQUAL(eventTrace.size(), 0);
+  for(int i=0; i<EVENT_TRACE_SIZE; ++i){
+    pulseClock();
+    callTimer();
+  }
+  BOOST_CHECK_EQUAL(eventTrace.size(), EVENT_TRACE_SIZE);
+  for(int i=1; i<EVENT_TRACE_SIZE; ++i)
+    BOOST_CHECK(eventTrace.get(i).time >= eventTrace.get(i-1).time);
+  BOOST_CHECK_EQUAL(eventTrace.get(EVENT_TRACE_SIZE-1).time - eventTrace.get(0).time, EVENT_TRACE_SIZE/2-1);
+}
+#endif
+
+#ifdef ISR_PROFILE
+BOOST_AUTO_TEST_CASE(testIsrProfile){
+  DefaultFixture fixture;
+  SerialCommand cmd;
+  BOOST_CHECK_EQUAL(parseCommand("Z128\n", cmd), SerialCommandParser::COMPLETE);
+  BOOST_CHECK(applyCommand(cmd));
+  BOOST_CHECK_EQUAL(isrProfiles[ISR_PROFILE_INT1].count, 0);
+  pulseClock(5);
+  callTimer(3);
+  BOOST_CHECK_EQUAL(isrProfiles[ISR_PROFILE_INT1].count, 10);
+  BOOST_CHECK_EQUAL(isrProfiles[ISR_PROFILE_TIMER0].count, 3);
+  BOOST_CHECK(isrProfiles[ISR_PROFILE_INT1].min <= isrProfiles[ISR_PROFILE_INT1].max);
+  BOOST_CHECK(applyCommand(cmd));
+  BOOST_CHECK_EQUAL(isrProfiles[ISR_PROFILE_INT1].count, 0);
+  BOOST_CHECK_EQUAL(isrProfiles[ISR_PROFILE_TIMER0].count, 0);
+}
+
+BOOST_AUTO_TEST_CASE(testIsrProfileSaturated){
+  IsrProfile p;
+  p.reset();
+  for(uint32_t i=0; i<0x10000; ++i)
+    p.add(100);
+  BOOST_CHECK_EQUAL(p.count, 0xffff);
+  // a worst case after the count saturates is still reported
+  p.add(900);
+  p.add(20);
+  BOOST_CHECK_EQUAL(p.max, 900);
+  BOOST_CHECK_EQUAL(p.min, 20);
+  BOOST_CHECK_EQUAL(p.mean(), 100);
+}
+#endif
+
+#ifdef LATENCY_HISTOGRAM
+BOOST_AUTO_TEST_CASE(testLatencyHistogram){
+  DefaultFixture fixture;
+  setDivide(0.0);
+  setDelayMode();
+  loop();
+  SerialCommand cmd;
+  BOOST_CHECK_EQUAL(parseCommand("T10 Z256\n", cmd), SerialCommandParser::COMPLETE);
+  BOOST_CHECK(applyCommand(cmd));
+  TCNT0 = 100; // clock edge arrives 50us into the timer period
+  setClock(true);
+  TCNT0 = 0;
+  BOOST_CHECK_EQUAL(latency[LATENCY_OUTPUTS+LATENCY_DIVIDE].count(), 1);
+  BOOST_CHECK_EQUAL(latency[LATENCY_OUTPUTS+LATENCY_DIVIDE].max, 0);
+  BOOST_CHECK_EQUAL(latency[LATENCY_OUTPUTS+LATENCY_COMBINED].count(), 0); // swing is timer driven
+  callTimer(9);
+  BOOST_CHECK(!delayIsHigh());
+  callTimer();
+  BOOST_CHECK(delayIsHigh());
+  LatencyHistogram& h = latency[LATENCY_OUTPUTS+LATENCY_DELAY];
+  BOOST_CHECK_EQUAL(h.count(), 1);
+  BOOST_CHECK_EQUAL(h.min, -100);
+  BOOST_CHECK_EQUAL(h.bins[LATENCY_BIN_ORIGIN+(-100>>LATENCY_BIN_SHIFT)], 1);
+  BOOST_CHECK_EQUAL(latency[LATENCY_OUTPUTS+LATENCY_COMBINED].max, -100);
+  BOOST_CHECK_EQUAL(latency[LATENCY_DELAY].count(), 0);
+  setClock(false);
+  BOOST_CHECK(applyCommand(cmd));
+  BOOST_CHECK_EQUAL(h.count(), 0);
+  callTimer(20); // the delayed pulses end
+  // the serial only modes, from the clock edge or the tick a pulse is due on
+  BOOST_CHECK_EQUAL(parseCommand("M3 C1 T10\n", cmd), SerialCommandParser::COMPLETE);
+  BOOST_CHECK(applyCommand(cmd));
+  TCNT0 = 100;
+  setClock(true);
+  TCNT0 = 10; // the timer handler runs 5us after the overflow
+  LatencyHistogram* serial = latency+2*LATENCY_OUTPUTS;
+  BOOST_CHECK_EQUAL(serial[LATENCY_COMBINED].count(), 1);
+  BOOST_CHECK_EQUAL(serial[LATENCY_COMBINED].max, 0);
+  BOOST_CHECK_EQUAL(serial[LATENCY_DELAY].count(), 1);
+  callTimer(10);
+  BOOST_CHECK_EQUAL(serial[LATENCY_DELAY].count(), 2);
+  BOOST_CHECK_EQUAL(serial[LATENCY_DELAY].max, 10);
+  setClock(false);
+  BOOST_CHECK_EQUAL(parseCommand("L\n", cmd), SerialCommandParser::COMPLETE);
+  BOOST_CHECK(applyCommand(cmd));
+}
+#endif
+
+#define MILLISECONDS 1000000ULL
+#define SECONDS (1000*MILLISECONDS)
+
+struct OutputCounter {
+  uint8_t last;
+  uint32_t rises[3];
+  ClockDelaySimulator::Time lastRise[3];
+  OutputCounter() : last(0xff) {
+    for(int i=0; i<3; ++i){
+      rises[i] = 0;
+      lastRise[i] = 0;
+    }
+  }
+  static void changed(void* ctx, ClockDelaySimulator::Time time, uint8_t port){
+    OutputCounter* counter = (OutputCounter*)ctx;
+    // outputs are active low
+    uint8_t activated = counter->last & ~port;
+    for(int i=0; i<3; ++i){
+      if(activated & _BV(DIVIDE_OUTPUT_PIN+i)){
+	counter->rises[i]++;
+	counter->lastRise[i] = time;
+      }
+    }
+    counter->last = port;
+  }
+};
+
+/* a simulator, dumping its run to $CLOCKDELAY_VCD/<test name>.vcd if set */
+struct SimulatorFixture {
+  ClockDelaySimulator sim;
+  ClockDelayVcd vcd;
+  SimulatorFixture(){
+    const char* dir = getenv("CLOCKDELAY_VCD");
+    if(dir != NULL){
+      std::string filename = std::string(dir) + "/" +
+	boost::unit_test::framework::current_test_case().p_name.get() + ".vcd";
+      BOOST_REQUIRE(vcd.open(filename.c_str(), sim));
+    }
+  }
+};
+
+BOOST_AUTO_TEST_CASE(testSimulatorTimerRate){
+  SimulatorFixture fixture;
+  ClockDelaySimulator& sim = fixture.sim;
+  sim.run(10*SECONDS);
+  BOOST_CHECK_EQUAL(sim.timerTicks(), 78125);
+  BOOST_CHECK_EQUAL(sim.time(), 10*SECONDS);
+}
+
+BOOST_AUTO_TEST_CASE(testSimulatorDelay){
+  SimulatorFixture fixture;
+  ClockDelaySimulator& sim = fixture.sim;
+  OutputCounter outputs;
+  sim.onOutput(OutputCounter::changed, &outputs);
+  sim.mode(0, ClockDelaySimulator::SWITCH_DELAY);
+  sim.knob(0, DELAY_ADC_CHANNEL, 0.1);
+  sim.run(10*MILLISECONDS);
+  uint16_t ticks = channel.delay.value;
+  BOOST_CHECK_EQUAL(ticks, 410);
+  // one clock pulse, 5ms long, 0.3ms into a timer period
+  sim.clock(100*MILLISECONDS+300000, true);
+  sim.clock(105*MILLISECONDS+300000, false);
+  sim.run(SECONDS);
+  BOOST_CHECK_EQUAL(outputs.rises[DELAY_OUTPUT_PIN], 1);
+  ClockDelaySimulator::Time delayed = outputs.lastRise[DELAY_OUTPUT_PIN] - (100*MILLISECONDS+300000);
+  BOOST_CHECK(delayed <= ticks*ClockDelaySimulator::TIMER_PERIOD);
+  BOOST_CHECK(delayed > (ticks-1)*ClockDelaySimulator::TIMER_PERIOD);
+  BOOST_CHECK(!delayIsHigh());
+}
+
+BOOST_AUTO_TEST_CASE(testSimulatorResetHold){
+  SimulatorFixture fixture;
+  ClockDelaySimulator& sim = fixture.sim;
+  sim.mode(0, ClockDelaySimulator::SWITCH_COUNT);
+  sim.knob(0, DIVIDE_ADC_CHANNEL, 0.05);
+  sim.clock(10*MILLISECONDS, 20*MILLISECONDS, 10*MILLISECONDS, 3);
+  sim.run(65*MILLISECONDS);
+  BOOST_CHECK(divideIsHigh());
+  sim.reset(70*MILLISECONDS, true);
+  // clock edges while reset is held are not counted
+  sim.clock(80*MILLISECONDS, 20*MILLISECONDS, 10*MILLISECONDS, 10);
+  sim.run(75*MILLISECONDS);
+  BOOST_CHECK(!divideIsHigh());
+  BOOST_CHECK_EQUAL(channel.divider.pos, 0);
+  sim.reset(265*MILLISECONDS, false);
+  sim.run(400*MILLISECONDS);
+  BOOST_CHECK_EQUAL(channel.divider.pos, 1);
+}
+
+BOOST_AUTO_TEST_CASE(testSimulatorClockLoss){
+  SimulatorFixture fixture;
+  ClockDelaySimulator& sim = fixture.sim;
+  sim.mode(0, ClockDelaySimulator::SWITCH_COUNT);
+  sim.analog(0, DIVIDE_ADC_CHANNEL, 3 << 7); // divide by four
+  sim.clock(10*MILLISECONDS, 10*MILLISECONDS, 5*MILLISECONDS, 4);
+  sim.run(45*MILLISECONDS);
+  BOOST_CHECK(divideIsHigh());
+  // lost four periods after the last rise
+  sim.run(79*MILLISECONDS);
+  BOOST_CHECK(divideIsHigh());
+  BOOST_CHECK(!channel.lost);
+  sim.run(81*MILLISECONDS);
+  BOOST_CHECK(!divideIsHigh());
+  BOOST_CHECK(channel.lost);
+  // the clock returns and the count carries on where it stopped
+  sim.clock(203*MILLISECONDS, 10*MILLISECONDS, 5*MILLISECONDS, 4);
+  sim.run(204*MILLISECONDS);
+  BOOST_CHECK(divideIsHigh());
+  BOOST_CHECK(!channel.lost);
+  sim.run(230*MILLISECONDS);
+  BOOST_CHECK(divideIsHigh());
+  sim.run(235*MILLISECONDS);
+  BOOST_CHECK(!divideIsHigh());
+}
+
+BOOST_AUTO_TEST_CASE(testSimulatorSlowClockLoss){
+  // a 3s period, four of which are more ticks than the counters hold
+  SimulatorFixture fixture;
+  ClockDelaySimulator& sim = fixture.sim;
+  sim.mode(0, ClockDelaySimulator::SWITCH_COUNT);
+  sim.clock(SECONDS, 3*SECONDS, 100*MILLISECONDS, 3);
+  sim.run(15*SECONDS);
+  BOOST_CHECK(!channel.lost);
+  // lost at the longest loss time, 65534 ticks after the last rise at 7s
+  sim.run(16*SECONDS);
+  BOOST_CHECK(channel.lost);
+}
+
+BOOST_AUTO_TEST_CASE(testSimulatorClockRest){
+  // a rhythm with a rest of over four periods keeps its phase
+  SimulatorFixture fixture;
+  ClockDelaySimulator& sim = fixture.sim;
+  OutputCounter outputs;
+  sim.onOutput(OutputCounter::changed, &outputs);
+  sim.mode(0, ClockDelaySimulator::SWITCH_COUNT);
+  sim.analog(0, DIVIDE_ADC_CHANNEL, 3 << 7); // divide by four
+  sim.analog(0, DELAY_ADC_CHANNEL, 2 << 7); // and count to three
+  sim.clock(10*MILLISECONDS, 10*MILLISECONDS, 5*MILLISECONDS, 6);
+  sim.run(110*MILLISECONDS);
+  BOOST_CHECK(channel.lost);
+  BOOST_CHECK(!divideIsHigh());
+  BOOST_CHECK_EQUAL(channel.divider.pos, 2);
+  BOOST_CHECK_EQUAL(channel.counter.pos, 0);
+  BOOST_CHECK_EQUAL(outputs.rises[DELAY_OUTPUT_PIN], 2);
+  sim.clock(200*MILLISECONDS, 10*MILLISECONDS, 5*MILLISECONDS, 6);
+  sim.run(201*MILLISECONDS);
+  BOOST_CHECK(divideIsHigh()); // rise 7 of 8, in the second half of the cycle
+  sim.run(211*MILLISECONDS);
+  BOOST_CHECK(!divideIsHigh());
+  sim.run(300*MILLISECONDS);
+  // as if the clock had not stopped: divided on rises 4 and 12, counted
+  // on every third, with one more divided rise after the rest
+  BOOST_CHECK_EQUAL(outputs.rises[DIVIDE_OUTPUT_PIN], 3);
+  BOOST_CHECK_EQUAL(outputs.rises[DELAY_OUTPUT_PIN], 4);
+}
+
+BOOST_AUTO_TEST_CASE(testSimulatorClockLossLongDelay){
+  // two triggers 100 ticks apart, delayed by more than four of them
+  SimulatorFixture fixture;
+  ClockDelaySimulator& sim = fixture.sim;
+  OutputCounter outputs;
+  sim.onOutput(OutputCounter::changed, &outputs);
+  sim.mode(0, ClockDelaySimulator::SWITCH_DELAY);
+  sim.analog(0, DELAY_ADC_CHANNEL, 449); // 450 ticks
+  ClockDelaySimulator::Time period = 100*ClockDelaySimulator::TIMER_PERIOD;
+  sim.clock(10*MILLISECONDS, period, 2*MILLISECONDS, 2);
+  ClockDelaySimulator::Time last = 10*MILLISECONDS + period;
+  sim.run(last + 400*ClockDelaySimulator::TIMER_PERIOD + MILLISECONDS);
+  BOOST_CHECK(!channel.lost);
+  sim.run(last + 600*ClockDelaySimulator::TIMER_PERIOD);
+  BOOST_CHECK(channel.lost);
+  BOOST_CHECK_EQUAL(outputs.rises[DELAY_OUTPUT_PIN], 1);
+  ClockDelaySimulator::Time delayed = outputs.lastRise[DELAY_OUTPUT_PIN] - last;
+  BOOST_CHECK(delayed <= 450*ClockDelaySimulator::TIMER_PERIOD);
+  BOOST_CHECK(delayed > 449*ClockDelaySimulator::TIMER_PERIOD);
+  BOOST_CHECK(!delayIsHigh());
+}
+
+BOOST_AUTO_TEST_CASE(testSimulatorClockStuckHigh){
+  SimulatorFixture fixture;
+  ClockDelaySimulator& sim = fixture.sim;
+  sim.mode(0, ClockDelaySimulator::SWITCH_DELAY);
+  sim.analog(0, DELAY_ADC_CHANNEL, 77); // 78 ticks, 10ms
+  sim.clock(10*MILLISECONDS, 20*MILLISECONDS, 5*MILLISECONDS, 3);
+  sim.clock(70*MILLISECONDS, true); // and never falls
+  sim.run(85*MILLISECONDS);
+  BOOST_CHECK(delayIsHigh());
+  sim.run(149*MILLISECONDS);
+  BOOST_CHECK(delayIsHigh());
+  sim.run(151*MILLISECONDS);
+  BOOST_CHECK(!delayIsHigh());
+  BOOST_CHECK(channel.lost);
+  sim.clock(160*MILLISECONDS, false);
+  sim.run(161*MILLISECONDS);
+  BOOST_CHECK(!delayIsHigh());
+  BOOST_CHECK(channel.lost); // a fall does not start anything
+  sim.clock(170*MILLISECONDS, true);
+  sim.run(181*MILLISECONDS);
+  BOOST_CHECK(delayIsHigh());
+  BOOST_CHECK(!channel.lost);
+}
+
+BOOST_AUTO_TEST_CASE(testSimulatorSoak){
+  // one hour of 24ppqn clock at 120bpm, in delay mode
+  SimulatorFixture fixture;
+  ClockDelaySimulator& sim = fixture.sim;
+  OutputCounter outputs;
+  sim.onOutput(OutputCounter::changed, &outputs);
+  sim.mode(0, ClockDelaySimulator::SWITCH_DELAY);
+  sim.knob(0, DIVIDE_ADC_CHANNEL, 0.25);
+  sim.knob(0, DELAY_ADC_CHANNEL, 0.01); // delay plus pulse width within one period
+  sim.run(10*MILLISECONDS);
+  uint32_t pulses = 3600*48;
+  ClockDelaySimulator::Time period = SECONDS/48;
+  sim.clock(SECONDS, period, period/2, pulses);
+  sim.run(3602*SECONDS);
+  BOOST_CHECK(!sim.isPending());
+  BOOST_CHECK_EQUAL(outputs.rises[DELAY_OUTPUT_PIN], pulses);
+  BOOST_CHECK_EQUAL(outputs.rises[DIVIDE_OUTPUT_PIN], pulses/(channel.divider.value+1)/2);
+  BOOST_CHECK_EQUAL(outputs.rises[COMBINED_OUTPUT_PIN], pulses);
+}
+
+BOOST_AUTO_TEST_CASE(testSimulatorVcd){
+  const char* filename = "build/testSimulatorVcd.vcd";
+  {
+    ClockDelaySimulator sim;
+    ClockDelayVcd vcd;
+    BOOST_REQUIRE(vcd.open(filename, sim));
+    sim.mode(0, ClockDelaySimulator::SWITCH_COUNT);
+    sim.clock(10*MILLISECONDS, 20*MILLISECONDS, 10*MILLISECONDS, 4);
+    sim.run(100*MILLISECONDS);
+    SerialCommand cmd;
+    parseCommand("M8\n", cmd); // the widest mode value
+    applyCommand(cmd);
+    sim.run(110*MILLISECONDS);
+  }
+  std::ifstream file(filename);
+  std::string line;
+  std::map<std::string, std::string> ids;
+  std::map<std::string, std::string> widths;
+  std::string mode;
+  std::vector<std::string> clock;
+  std::string time;
+  bool definitions = true;
+  while(std::getline(file, line)){
+    if(definitions){
+      std::istringstream words(line);
+      std::string var, type, width, id, name;
+      words >> var >> type >> width >> id >> name;
+      if(var == "$var"){
+	ids[name] = id;
+	widths[name] = width;
+      }
+      else if(var == "$enddefinitions")
+	definitions = false;
+    }else if(line[0] == '#'){
+      time = line.substr(1);
+    }else if(line.size() == 2 && line.substr(1) == ids["clock_in"]){
+      clock.push_back(time + ":" + line[0]);
+    }else if(line[0] == 'b' && line.substr(line.find(' ')+1) == ids["mode"]){
+      mode = line.substr(0, line.find(' '));
+    }
+  }
+  BOOST_CHECK_EQUAL(widths["mode"], "4");
+  BOOST_CHECK_EQUAL(mode, "b1000");
+  BOOST_CHECK_EQUAL(ids.size(), 20);
+  BOOST_CHECK_EQUAL(widths["wide_pos"], "16");
+  BOOST_CHECK_EQUAL(widths["euclid_pos"], "8");
+  BOOST_CHECK_EQUAL(widths["looper_state"], "2");
+  BOOST_REQUIRE_EQUAL(clock.size(), 9);
+  BOOST_CHECK_EQUAL(clock[0], "0:0");
+  BOOST_CHECK_EQUAL(clock[1], "10000000:1");
+  BOOST_CHECK_EQUAL(clock[2], "20000000:0");
+  BOOST_CHECK_EQUAL(clock[8], "80000000:0");
+}
+
+BOOST_AUTO_TEST_CASE(testTraceRoundTrip){
+  TraceScenario stimulus;
+  stimulus.push_back(TraceRecord(0, TRACE_SWITCH, ClockDelaySimulator::SWITCH_COUNT));
+  stimulus.push_back(TraceRecord(0, TRACE_KNOB, 300, DIVIDE_ADC_CHANNEL));
+  for(int i=0; i<8; ++i){
+    stimulus.push_back(TraceRecord((10+20*i)*MILLISECONDS, TRACE_CLOCK_HIGH));
+    stimulus.push_back(TraceRecord((20+20*i)*MILLISECONDS, TRACE_CLOCK_LOW));
+  }
+  stimulus.push_back(TraceRecord(200*MILLISECONDS, TRACE_END));
+  TraceScenario recorded = traceRun(stimulus);
+  // with the counter at one, port B changes on every clock edge
+  BOOST_CHECK_EQUAL(recorded.size(), stimulus.size() + 16);
+  BOOST_CHECK_EQUAL(traceDiff(recorded, traceRun(recorded)), -1);
+
+  const char* filename = "build/testTraceRoundTrip.cdt";
+  TraceWriter writer;
+  writer.write(recorded);
+  writer.write(stimulus);
+  BOOST_REQUIRE(writer.save(filename));
+  TraceReader reader;
+  BOOST_REQUIRE(reader.load(filename));
+  TraceScenario s;
+  BOOST_CHECK(reader.read(s));
+  BOOST_CHECK_EQUAL(traceDiff(recorded, s), -1);
+  BOOST_CHECK(reader.read(s));
+  BOOST_CHECK_EQUAL(traceDiff(stimulus, s), -1);
+  BOOST_CHECK(!reader.read(s));
+  BOOST_CHECK(!reader.isCorrupt());
+
+  // a changed output time is reported at its record
+  s = recorded;
+  s[3].time += ClockDelaySimulator::TIMER_PERIOD;
+  BOOST_CHECK_EQUAL(traceDiff(s, traceRun(s)), 3);
+
+  // serial commands are replayed, and stored with their text
+  TraceRecord command(0, TRACE_COMMAND);
+  command.text = "M3\n";
+  stimulus.insert(stimulus.begin()+2, command);
+  TraceScenario burst = traceRun(stimulus);
+  BOOST_CHECK(burst.size() > recorded.size()+1); // and the delay output pulses too
+  BOOST_CHECK_EQUAL(traceDiff(burst, traceRun(burst)), -1);
+  TraceWriter commands;
+  commands.write(burst);
+  BOOST_REQUIRE(commands.save(filename));
+  TraceReader replay;
+  BOOST_REQUIRE(replay.load(filename));
+  BOOST_CHECK(replay.read(s));
+  BOOST_CHECK_EQUAL(traceDiff(burst, s), -1);
+  BOOST_CHECK_EQUAL(s[2].text, "M3\n");
+}
+
 // BOOST_AUTO_TEST_CASE(testDummy){
 //   DefaultFixture fixture;
 //   setDivide(0.6);
@@ -603,10 +1721,10 @@ BOOST_AUTO_TEST_CASE(testDivideByOneAndCount){
 //   for(int i=0; i<20; ++i){
 //     toggleClock();
 //     printString(clockIsHigh() ? "in  high " : "in  low ");
-//     divider.dump();
+//     channel.divider.dump();
 //     printNewline();
 //     printString(combinedIsHigh() ? "out high " : "out low ");
-//     counter.dump();
+//     channel.counter.dump();
 //     printNewline();
 //   }
 // }
@@ -0,0 +1,175 @@
+/*
+Golden trace recording and replay.
+make trace-record   records traces/golden.cdt from the current build
+make trace-check    replays it and reports any difference, also run by make test
+or: ClockDelayTrace record <file> [scenarios] [seed]
+    ClockDelayTrace replay <file>...
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <algorithm>
+
+#include <avr/io.h>
+
+#include "ClockDelay.cpp"
+#include "ClockDelayTrace.h"
+
+#define MILLISECONDS 1000000ULL
+
+typedef std::chrono::steady_clock Clock;
+
+/* xorshift32, so that scenarios are the same on every host */
+uint32_t nextRandom(uint32_t& state, uint32_t range){
+  state ^= state << 13;
+  state ^= state >> 17;
+  state ^= state << 5;
+  return state % range;
+}
+
+bool earlier(const TraceRecord& a, const TraceRecord& b){
+  return a.time < b.time;
+}
+
+/**
+ * A random scenario: a mode and knob settings, then a clock with jitter
+ * and varying duty cycle, with some runs also turning a knob, pulsing
+ * reset or changing the mode switch part way through. Half the runs set
+ * one of the modes that are only selected over serial, arming the looper
+ * in loop mode; the switch then has no effect, so these runs leave it.
+ */
+TraceScenario generate(uint32_t& state){
+  TraceScenario s;
+  ClockDelaySimulator::Time t = 0;
+  s.push_back(TraceRecord(t, TRACE_SWITCH, nextRandom(state, 2)));
+  s.push_back(TraceRecord(t, TRACE_KNOB, nextRandom(state, ADC_VALUE_RANGE), DIVIDE_ADC_CHANNEL));
+  // mostly delays shorter than the clock period, sometimes up to the maximum
+  uint16_t delay = nextRandom(state, 4) ? nextRandom(state, ADC_VALUE_RANGE/16) : nextRandom(state, ADC_VALUE_RANGE);
+  s.push_back(TraceRecord(t, TRACE_KNOB, delay, DELAY_ADC_CHANNEL));
+  bool remote = nextRandom(state, 2);
+  if(remote){
+    uint32_t mode = BURST_MODE + nextRandom(state, WIDE_MODE-BURST_MODE+1);
+    char line[16];
+    snprintf(line, sizeof(line), mode == LOOP_MODE ? "M%u A1\n" : "M%u\n", (unsigned)mode);
+    TraceRecord command(t, TRACE_COMMAND);
+    command.text = line;
+    s.push_back(command);
+  }
+  ClockDelaySimulator::Time period = (2 + nextRandom(state, 48))*MILLISECONDS;
+  uint32_t edges = 16 + nextRandom(state, 48);
+  uint32_t event = nextRandom(state, 4) ? nextRandom(state, edges) : edges; // edge before which a change is made
+  uint32_t kind = nextRandom(state, remote ? 2 : 3);
+  t = 10*MILLISECONDS;
+  for(uint32_t i=0; i<edges; ++i){
+    ClockDelaySimulator::Time length = period - period/8 + nextRandom(state, period/4);
+    if(i == event){
+      ClockDelaySimulator::Time at = t + nextRandom(state, length/2);
+      switch(kind){
+      case 0:
+	s.push_back(TraceRecord(at, TRACE_KNOB, nextRandom(state, ADC_VALUE_RANGE), nextRandom(state, 2)));
+	break;
+      case 1:
+	s.push_back(TraceRecord(at, TRACE_RESET_HIGH));
+	s.push_back(TraceRecord(at + 1 + nextRandom(state, length/2), TRACE_RESET_LOW));
+	break;
+      case 2:
+	s.push_back(TraceRecord(at, TRACE_SWITCH, nextRandom(state, 3)));
+	s.push_back(TraceRecord(at + 1 + nextRandom(state, length/2), TRACE_SWITCH, nextRandom(state, 2)));
+	break;
+      }
+    }
+    ClockDelaySimulator::Time width = length/10 + nextRandom(state, length*8/10);
+    s.push_back(TraceRecord(t+length/2, TRACE_CLOCK_HIGH));
+    s.push_back(TraceRecord(t+length/2+width/2, TRACE_CLOCK_LOW));
+    t += length;
+  }
+  std::stable_sort(s.begin(), s.end(), earlier);
+  // long enough for the longest delay to play out
+  s.push_back(TraceRecord(t + 600*MILLISECONDS, TRACE_END));
+  return s;
+}
+
+int record(const char* filename, uint32_t scenarios, uint32_t seed){
+  TraceWriter writer;
+  uint32_t state = seed ? seed : 1;
+  for(uint32_t i=0; i<scenarios; ++i)
+    writer.write(traceRun(generate(state)));
+  if(!writer.save(filename)){
+    perror(filename);
+    return 1;
+  }
+  printf("%s: %u scenarios, %lu bytes\n", filename, scenarios, (unsigned long)writer.size());
+  return 0;
+}
+
+void print(const TraceScenario& s, long i){
+  if(i >= (long)s.size()){
+    printf("(none)");
+    return;
+  }
+  static const char* types[] = { "clock low", "clock high", "reset low", "reset high",
+				 "knob", "switch", "output", "end", "command" };
+  const TraceRecord& r = s[i];
+  printf("%lluns %s", (unsigned long long)r.time, types[r.type]);
+  if(r.type == TRACE_KNOB)
+    printf(" %u %u", r.channel, r.value);
+  else if(r.type == TRACE_SWITCH)
+    printf(" %u", r.value);
+  else if(r.type == TRACE_OUTPUT)
+    printf(" 0x%02x", r.value);
+  else if(r.type == TRACE_COMMAND)
+    printf(" %.*s", (int)r.text.size() - 1, r.text.c_str()); // without the newline
+}
+
+int replay(const char* filename){
+  TraceReader reader;
+  if(!reader.load(filename)){
+    fprintf(stderr, "%s: cannot read trace\n", filename);
+    return 1;
+  }
+  Clock::time_point start = Clock::now();
+  TraceScenario expected;
+  uint32_t scenarios = 0;
+  uint32_t failures = 0;
+  while(reader.read(expected)){
+    TraceScenario actual = traceRun(expected);
+    long diff = traceDiff(expected, actual);
+    if(diff >= 0){
+      if(failures < 10){
+	printf("%s: scenario %u differs at record %ld\n  expected ", filename, scenarios, diff);
+	print(expected, diff);
+	printf("\n  actual   ");
+	print(actual, diff);
+	printf("\n");
+      }
+      failures++;
+    }
+    scenarios++;
+  }
+  if(reader.isCorrupt()){
+    fprintf(stderr, "%s: corrupt after scenario %u\n", filename, scenarios);
+    return 1;
+  }
+  double seconds = std::chrono::duration<double>(Clock::now()-start).count();
+  printf("%s: %u scenarios, %u differ, %.2fs\n", filename, scenarios, failures, seconds);
+  return failures ? 1 : 0;
+}
+
+int main(int argc, char** argv){
+  if(argc >= 3 && strcmp(argv[1], "record") == 0){
+    uint32_t scenarios = argc > 3 ? strtoul(argv[3], NULL, 10) : 1000;
+    uint32_t seed = argc > 4 ? strtoul(argv[4], NULL, 10) : 1;
+    return record(argv[2], scenarios, seed);
+  }
+  if(argc >= 3 && strcmp(argv[1], "replay") == 0){
+    int status = 0;
+    for(int i=2; i<argc; ++i)
+      status |= replay(argv[i]);
+    return status;
+  }
+  fprintf(stderr, "usage: %s record <file> [scenarios] [seed]\n"
+	  "       %s replay <file>...\n", argv[0], argv[0]);
+  return 2;
+}
@@ -0,0 +1,256 @@
+#ifndef _CLOCKDELAY_TRACE_H_
+#define _CLOCKDELAY_TRACE_H_
+
+#include <stdio.h>
+#include <inttypes.h>
+#include <string>
+#include <vector>
+#include "ClockDelaySimulator.h"
+
+#define TRACE_VERSION              2
+#define TRACE_TYPE_BITS            4
+
+/**
+ * Golden traces: input stimulus together with the output transitions it
+ * produced, recorded from one build and replayed against another.
+ *
+ * A trace file is the bytes "CDT" and a version byte, followed by any
+ * number of scenarios. A scenario is a list of records in time order,
+ * closed by an end record whose time is when the run stops. Each record
+ * is a varint of (nanoseconds since the previous record << 4 | type),
+ * followed by a payload for some types: a channel byte and a varint value
+ * for knobs, the position byte for the switch, the port B byte for
+ * outputs and a varint length and the text for serial commands. Varints are little endian, 7 bits per byte. Time starts from
+ * zero in each scenario.
+ */
+
+enum TraceType {
+  TRACE_CLOCK_LOW = 0,
+  TRACE_CLOCK_HIGH,
+  TRACE_RESET_LOW,
+  TRACE_RESET_HIGH,
+  TRACE_KNOB,
+  TRACE_SWITCH,
+  TRACE_OUTPUT,
+  TRACE_END,
+  TRACE_COMMAND
+};
+
+struct TraceRecord {
+  ClockDelaySimulator::Time time;
+  uint8_t type;
+  uint8_t channel;
+  uint16_t value;
+  std::string text; // serial command line
+  TraceRecord(ClockDelaySimulator::Time t = 0, uint8_t ty = TRACE_END, uint16_t v = 0, uint8_t ch = 0)
+    : time(t), type(ty), channel(ch), value(v) {}
+  bool operator==(const TraceRecord& other) const {
+    return time == other.time && type == other.type &&
+      channel == other.channel && value == other.value && text == other.text;
+  }
+  bool operator!=(const TraceRecord& other) const {
+    return !(*this == other);
+  }
+};
+
+typedef std::vector<TraceRecord> TraceScenario;
+
+class TraceWriter {
+public:
+  TraceWriter(){
+    data.push_back('C');
+    data.push_back('D');
+    data.push_back('T');
+    data.push_back(TRACE_VERSION);
+  }
+  void write(const TraceScenario& scenario){
+    ClockDelaySimulator::Time last = 0;
+    for(size_t i=0; i<scenario.size(); ++i){
+      const TraceRecord& r = scenario[i];
+      varint(((r.time - last) << TRACE_TYPE_BITS) | r.type);
+      last = r.time;
+      switch(r.type){
+      case TRACE_KNOB:
+	data.push_back(r.channel);
+	varint(r.value);
+	break;
+      case TRACE_SWITCH:
+      case TRACE_OUTPUT:
+	data.push_back(r.value);
+	break;
+      case TRACE_COMMAND:
+	varint(r.text.size());
+	data.insert(data.end(), r.text.begin(), r.text.end());
+	break;
+      }
+    }
+  }
+  size_t size(){
+    return data.size();
+  }
+  bool save(const char* filename){
+    FILE* file = fopen(filename, "wb");
+    if(file == NULL)
+      return false;
+    bool ok = fwrite(&data[0], 1, data.size(), file) == data.size();
+    return fclose(file) == 0 && ok;
+  }
+private:
+  std::vector<uint8_t> data;
+  void varint(uint64_t v){
+    while(v >= 0x80){
+      data.push_back(0x80 | (v & 0x7f));
+      v >>= 7;
+    }
+    data.push_back(v);
+  }
+};
+
+class TraceReader {
+public:
+  TraceReader() : pos(0), error(false) {}
+  bool load(const char* filename){
+    FILE* file = fopen(filename, "rb");
+    if(file == NULL)
+      return false;
+    uint8_t buf[4096];
+    size_t n;
+    while((n = fread(buf, 1, sizeof(buf), file)) > 0)
+      data.insert(data.end(), buf, buf+n);
+    fclose(file);
+    return data.size() >= 4 && data[0] == 'C' && data[1] == 'D' &&
+      data[2] == 'T' && data[3] == TRACE_VERSION;
+  }
+  /* false at the end of the file, or if it is truncated or corrupt */
+  bool read(TraceScenario& scenario){
+    scenario.clear();
+    if(pos < 4)
+      pos = 4;
+    ClockDelaySimulator::Time time = 0;
+    while(pos < data.size()){
+      uint64_t head = varint();
+      TraceRecord r;
+      time += head >> TRACE_TYPE_BITS;
+      r.time = time;
+      r.type = head & ((1 << TRACE_TYPE_BITS)-1);
+      switch(r.type){
+      case TRACE_KNOB:
+	r.channel = byte();
+	r.value = varint();
+	break;
+      case TRACE_SWITCH:
+      case TRACE_OUTPUT:
+	r.value = byte();
+	break;
+      case TRACE_COMMAND:
+	for(uint64_t n=varint(); n && !error; --n)
+	  r.text += byte();
+	break;
+      }
+      if(error)
+	return false;
+      scenario.push_back(r);
+      if(r.type == TRACE_END)
+	return true;
+    }
+    if(!scenario.empty())
+      error = true; // no end record
+    return false;
+  }
+  bool isCorrupt(){
+    return error;
+  }
+private:
+  std::vector<uint8_t> data;
+  size_t pos;
+  bool error;
+  uint8_t byte(){
+    if(pos == data.size()){
+      error = true;
+      return 0;
+    }
+    return data[pos++];
+  }
+  uint64_t varint(){
+    uint64_t v = 0;
+    for(uint8_t shift=0; shift<64; shift+=7){
+      uint8_t b = byte();
+      v |= (uint64_t)(b & 0x7f) << shift;
+      if(!(b & 0x80))
+	return v;
+    }
+    error = true;
+    return v;
+  }
+};
+
+/**
+ * Runs the stimulus of a scenario on a freshly set up simulator and
+ * returns it merged with the output transitions of this build, ready to
+ * be stored or compared. Recorded outputs in the argument are ignored.
+ */
+inline TraceScenario traceRun(const TraceScenario& stimulus){
+  struct Outputs {
+    TraceScenario changes;
+    static void changed(void* ctx, ClockDelaySimulator::Time time, uint8_t port){
+      ((Outputs*)ctx)->changes.push_back(TraceRecord(time, TRACE_OUTPUT, port));
+    }
+  } outputs;
+  ClockDelaySimulator sim;
+  sim.onOutput(Outputs::changed, &outputs);
+  ClockDelaySimulator::Time end = 0;
+  for(size_t i=0; i<stimulus.size(); ++i){
+    const TraceRecord& r = stimulus[i];
+    switch(r.type){
+    case TRACE_CLOCK_LOW:
+    case TRACE_CLOCK_HIGH:
+      sim.clock(r.time, r.type == TRACE_CLOCK_HIGH);
+      break;
+    case TRACE_RESET_LOW:
+    case TRACE_RESET_HIGH:
+      sim.reset(r.time, r.type == TRACE_RESET_HIGH);
+      break;
+    case TRACE_KNOB:
+      sim.analog(r.time, r.channel, r.value);
+      break;
+    case TRACE_SWITCH:
+      sim.mode(r.time, (ClockDelaySimulator::SwitchPosition)r.value);
+      break;
+    case TRACE_COMMAND:
+      sim.serial(r.time, r.text);
+      break;
+    case TRACE_END:
+      end = r.time;
+      break;
+    }
+  }
+  sim.run(end);
+  // stimulus first where times are equal, as the simulator handles it first
+  TraceScenario merged;
+  size_t o = 0;
+  for(size_t i=0; i<stimulus.size(); ++i){
+    const TraceRecord& r = stimulus[i];
+    if(r.type == TRACE_OUTPUT)
+      continue;
+    while(o < outputs.changes.size() && outputs.changes[o].time < r.time)
+      merged.push_back(outputs.changes[o++]);
+    if(r.type == TRACE_END)
+      while(o < outputs.changes.size())
+	merged.push_back(outputs.changes[o++]);
+    merged.push_back(r);
+  }
+  return merged;
+}
+
+/* index of the first record that differs, or -1 if the scenarios are identical */
+inline long traceDiff(const TraceScenario& expected, const TraceScenario& actual){
+  size_t n = expected.size() < actual.size() ? expected.size() : actual.size();
+  for(size_t i=0; i<n; ++i)
+    if(expected[i] != actual[i])
+      return i;
+  if(expected.size() != actual.size())
+    return n;
+  return -1;
+}
+
+#endif /* _CLOCKDELAY_TRACE_H_ */
@@ -0,0 +1,85 @@
+#ifndef _CLOCKDELAY_VCD_H_
+#define _CLOCKDELAY_VCD_H_
+
+#include "ClockDelaySimulator.h"
+#include "VcdWriter.h"
+
+/**
+ * Waveform dump of a simulation run, for viewing in GTKWave.
+ * Records the clock and reset inputs and the outputs at their logical
+ * levels (the hardware inverts both), the LEDs, the operating mode, the
+ * position counters of the dividers, counters, delays, burst, Euclidean
+ * rhythm and looper, and the burst and looper states, sampled after every
+ * simulation step at its virtual time.
+ * Include after ClockDelay.cpp, whose globals are sampled.
+ */
+class ClockDelayVcd {
+public:
+  bool open(const char* filename, ClockDelaySimulator& sim){
+    if(!vcd.open(filename))
+      return false;
+    clockIn = vcd.add("clock_in");
+    resetIn = vcd.add("reset_in");
+    divideOut = vcd.add("divide_out");
+    delayOut = vcd.add("delay_out");
+    combinedOut = vcd.add("combined_out");
+    led[0] = vcd.add("led_1");
+    led[1] = vcd.add("led_2");
+    led[2] = vcd.add("led_3");
+    modeState = vcd.add("mode", 4);
+    dividerPos = vcd.add("divider_pos", 8);
+    counterPos = vcd.add("counter_pos", 8);
+    divcounterPos = vcd.add("divcounter_pos", 8);
+    delayPos = vcd.add("delay_pos", 16);
+    swingPos = vcd.add("swing_pos", 16);
+    widePos = vcd.add("wide_pos", 16);
+    burstPos = vcd.add("burst_pos", 16);
+    burstLeft = vcd.add("burst_left", 8);
+    euclidPos = vcd.add("euclid_pos", 8);
+    looperPos = vcd.add("looper_pos", 16);
+    looperState = vcd.add("looper_state", 2);
+    sim.onStep(step, this);
+    sample(sim.time());
+    return true;
+  }
+  void close(){
+    vcd.close();
+  }
+  void sample(ClockDelaySimulator::Time time){
+    vcd.at(time);
+    vcd.set(clockIn, !(CLOCKDELAY_CLOCK_PINS & _BV(CLOCKDELAY_CLOCK_PIN)));
+    vcd.set(resetIn, !(CLOCKDELAY_RESET_PINS & _BV(CLOCKDELAY_RESET_PIN)));
+    vcd.set(divideOut, !(DIVIDE_OUTPUT_PINS & _BV(DIVIDE_OUTPUT_PIN)));
+    vcd.set(delayOut, !(DELAY_OUTPUT_PINS & _BV(DELAY_OUTPUT_PIN)));
+    vcd.set(combinedOut, !(COMBINED_OUTPUT_PINS & _BV(COMBINED_OUTPUT_PIN)));
+    vcd.set(led[0], (CLOCKDELAY_LEDS_PINS & _BV(CLOCKDELAY_LED_1_PIN)) != 0);
+    vcd.set(led[1], (CLOCKDELAY_LEDS_PINS & _BV(CLOCKDELAY_LED_2_PIN)) != 0);
+    vcd.set(led[2], (CLOCKDELAY_LEDS_PINS & _BV(CLOCKDELAY_LED_3_PIN)) != 0);
+    vcd.set(modeState, channel.mode);
+    vcd.set(dividerPos, channel.divider.pos);
+    vcd.set(counterPos, channel.counter.pos);
+    vcd.set(divcounterPos, channel.divcounter.pos);
+    vcd.set(delayPos, channel.delay.pos);
+    vcd.set(swingPos, channel.swinger.pos);
+    vcd.set(widePos, channel.widecounter.pos);
+    vcd.set(burstPos, channel.burst.pos);
+    vcd.set(burstLeft, channel.burst.left);
+    vcd.set(euclidPos, channel.euclid.pos);
+    vcd.set(looperPos, channel.looper.pos);
+    vcd.set(looperState, channel.looper.state);
+  }
+private:
+  VcdWriter vcd;
+  int clockIn, resetIn;
+  int divideOut, delayOut, combinedOut;
+  int led[3];
+  int modeState;
+  int dividerPos, counterPos, divcounterPos, delayPos, swingPos;
+  int widePos, burstPos, burstLeft, euclidPos, looperPos, looperState;
+
+  static void step(void* context, ClockDelaySimulator::Time time){
+    ((ClockDelayVcd*)context)->sample(time);
+  }
+};
+
+#endif /* _CLOCKDELAY_VCD_H_ */
@@ -9,7 +9,7 @@ template<int16_t threshold>
 class DeadbandController {
 public:
   int16_t value;
-  virtual void hasChanged(uint16_t v){}
+  virtual void hasChanged(uint16_t){}
   void update(uint16_t v){
     int16_t delta = static_cast<int16_t>(v) - static_cast<int16_t>(value);
     if(delta < 0)
@@ -0,0 +1,150 @@
+/* Generated by ClockDelayEuclid, do not edit: make euclid-patterns */
+#ifndef _EUCLID_PATTERNS_H_
+#define _EUCLID_PATTERNS_H_
+
+#include <inttypes.h>
+#include <avr/pgmspace.h>
+
+#define EUCLID_MAX_STEPS           32
+/* index of the pattern of 'hits' in 'steps', for 1 <= hits <= steps */
+#define EUCLID_INDEX(steps, hits)  ((uint16_t)((steps)-1)*(steps)/2 + (hits)-1)
+
+/* bit i is set if step i is a hit */
+const uint32_t euclidPatterns[] PROGMEM = {
+  // 1 step
+  0x00000001,
+  // 2 steps
+  0x00000001, 0x00000003,
+  // 3 steps
+  0x00000001, 0x00000005, 0x00000007,
+  // 4 steps
+  0x00000001, 0x00000005, 0x0000000d, 0x0000000f,
+  // 5 steps
+  0x00000001, 0x00000009, 0x00000015, 0x0000001d, 0x0000001f,
+  // 6 steps
+  0x00000001, 0x00000009, 0x00000015, 0x0000002d, 0x0000003d, 0x0000003f,
+  // 7 steps
+  0x00000001, 0x00000011, 0x00000029, 0x00000055, 0x0000006d, 0x0000007d,
+  0x0000007f,
+  // 8 steps
+  0x00000001, 0x00000011, 0x00000049, 0x00000055, 0x000000b5, 0x000000dd,
+  0x000000fd, 0x000000ff,
+  // 9 steps
+  0x00000001, 0x00000021, 0x00000049, 0x000000a9, 0x00000155, 0x0000016d,
+  0x000001dd, 0x000001fd, 0x000001ff,
+  // 10 steps
+  0x00000001, 0x00000021, 0x00000091, 0x00000129, 0x00000155, 0x000002b5,
+  0x0000036d, 0x000003bd, 0x000003fd, 0x000003ff,
+  // 11 steps
+  0x00000001, 0x00000041, 0x00000111, 0x00000249, 0x000002a9, 0x00000555,
+  0x000005b5, 0x000006ed, 0x000007bd, 0x000007fd, 0x000007ff,
+  // 12 steps
+  0x00000001, 0x00000041, 0x00000111, 0x00000249, 0x00000529, 0x00000555,
+  0x00000ad5, 0x00000b6d, 0x00000ddd, 0x00000f7d, 0x00000ffd, 0x00000fff,
+  // 13 steps
+  0x00000001, 0x00000081, 0x00000221, 0x00000491, 0x00000949, 0x00000aa9,
+  0x00001555, 0x000016b5, 0x00001b6d, 0x00001ddd, 0x00001f7d, 0x00001ffd,
+  0x00001fff,
+  // 14 steps
+  0x00000001, 0x00000081, 0x00000421, 0x00000891, 0x00001249, 0x000014a9,
+  0x00001555, 0x00002ad5, 0x00002db5, 0x000036ed, 0x00003bdd, 0x00003efd,
+  0x00003ffd, 0x00003fff,
+  // 15 steps
+  0x00000001, 0x00000101, 0x00000421, 0x00001111, 0x00001249, 0x00002529,
+  0x00002aa9, 0x00005555, 0x000056b5, 0x00005b6d, 0x00006eed, 0x000077bd,
+  0x00007efd, 0x00007ffd, 0x00007fff,
+  // 16 steps
+  0x00000001, 0x00000101, 0x00000841, 0x00001111, 0x00002491, 0x00004949,
+  0x000054a9, 0x00005555, 0x0000ab55, 0x0000b5b5, 0x0000db6d, 0x0000dddd,
+  0x0000f7bd, 0x0000fdfd, 0x0000fffd, 0x0000ffff,
+  // 17 steps
+  0x00000001, 0x00000201, 0x00001041, 0x00002221, 0x00004891, 0x00009249,
+  0x0000a529, 0x0000aaa9, 0x00015555, 0x00015ad5, 0x00016db5, 0x0001b76d,
+  0x0001dddd, 0x0001efbd, 0x0001fdfd, 0x0001fffd, 0x0001ffff,
+  // 18 steps
+  0x00000001, 0x00000201, 0x00001041, 0x00004221, 0x00008911, 0x00009249,
+  0x00012949, 0x000152a9, 0x00015555, 0x0002ab55, 0x0002d6b5, 0x0002db6d,
+  0x000376ed, 0x0003bbdd, 0x0003df7d, 0x0003fbfd, 0x0003fffd, 0x0003ffff,
+  // 19 steps
+  0x00000001, 0x00000401, 0x00002081, 0x00008421, 0x00011111, 0x00012491,
+  0x00024a49, 0x00029529, 0x0002aaa9, 0x00055555, 0x00056ad5, 0x0005b5b5,
+  0x0006db6d, 0x0006eeed, 0x00077bdd, 0x0007df7d, 0x0007fbfd, 0x0007fffd,
+  0x0007ffff,
+  // 20 steps
+  0x00000001, 0x00000401, 0x00004081, 0x00008421, 0x00011111, 0x00024491,
+  0x00049249, 0x0004a529, 0x000552a9, 0x00055555, 0x000aad55, 0x000ad6b5,
+  0x000b6db5, 0x000db76d, 0x000ddddd, 0x000ef7bd, 0x000fbf7d, 0x000ff7fd,
+  0x000ffffd, 0x000fffff,
+  // 21 steps
+  0x00000001, 0x00000801, 0x00004081, 0x00010841, 0x00022221, 0x00044891,
+  0x00049249, 0x00094949, 0x000a54a9, 0x000aaaa9, 0x00155555, 0x00156ad5,
+  0x0016b6b5, 0x0016db6d, 0x001b76ed, 0x001ddddd, 0x001ef7bd, 0x001f7efd,
+  0x001ff7fd, 0x001ffffd, 0x001fffff,
+  // 22 steps
+  0x00000001, 0x00000801, 0x00008101, 0x00020841, 0x00044221, 0x00088911,
+  0x00092491, 0x00124a49, 0x0014a529, 0x00154aa9, 0x00155555, 0x002aad55,
+  0x002b5ad5, 0x002dadb5, 0x0036db6d, 0x00376eed, 0x003bbddd, 0x003defbd,
+  0x003f7efd, 0x003feffd, 0x003ffffd, 0x003fffff,
+  // 23 steps
+  0x00000001, 0x00001001, 0x00010101, 0x00041041, 0x00084421, 0x00111111,
+  0x00124491, 0x00249249, 0x00252949, 0x002a54a9, 0x002aaaa9, 0x00555555,
+  0x0055ab55, 0x005ad6b5, 0x005b6db5, 0x006dbb6d, 0x006eeeed, 0x0077bbdd,
+  0x007befbd, 0x007efefd, 0x007feffd, 0x007ffffd, 0x007fffff,
+  // 24 steps
+  0x00000001, 0x00001001, 0x00010101, 0x00041041, 0x00108421, 0x00111111,
+  0x00244891, 0x00249249, 0x00494949, 0x00529529, 0x00554aa9, 0x00555555,
+  0x00aab555, 0x00ad5ad5, 0x00b5b5b5, 0x00b6db6d, 0x00dbb76d, 0x00dddddd,
+  0x00ef7bdd, 0x00f7df7d, 0x00fdfdfd, 0x00ffdffd, 0x00fffffd, 0x00ffffff,
+  // 25 steps
+  0x00000001, 0x00002001, 0x00020201, 0x00082081, 0x00108421, 0x00222221,
+  0x00448911, 0x00492491, 0x00925249, 0x0094a529, 0x00a954a9, 0x00aaaaa9,
+  0x01555555, 0x0156ab55, 0x015ad6b5, 0x016dadb5, 0x01b6db6d, 0x01bb76ed,
+  0x01dddddd, 0x01def7bd, 0x01f7df7d, 0x01fdfdfd, 0x01ffdffd, 0x01fffffd,
+  0x01ffffff,
+  // 26 steps
+  0x00000001, 0x00002001, 0x00040201, 0x00102081, 0x00210841, 0x00442221,
+  0x00889111, 0x00922491, 0x01249249, 0x01292949, 0x014a9529, 0x01552aa9,
+  0x01555555, 0x02aab555, 0x02b56ad5, 0x02d6b6b5, 0x02db6db5, 0x036dbb6d,
+  0x03776eed, 0x03bbbddd, 0x03def7bd, 0x03efbf7d, 0x03fbfdfd, 0x03ffbffd,
+  0x03fffffd, 0x03ffffff,
+  // 27 steps
+  0x00000001, 0x00004001, 0x00040201, 0x00204081, 0x00420841, 0x00844221,
+  0x01111111, 0x01224891, 0x01249249, 0x024a4a49, 0x0294a529, 0x02a552a9,
+  0x02aaaaa9, 0x05555555, 0x0556ab55, 0x056b5ad5, 0x05b5b5b5, 0x05b6db6d,
+  0x06ddb76d, 0x06eeeeed, 0x0777bbdd, 0x07bdf7bd, 0x07dfbf7d, 0x07f7fbfd,
+  0x07ffbffd, 0x07fffffd, 0x07ffffff,
+  // 28 steps
+  0x00000001, 0x00004001, 0x00080401, 0x00204081, 0x00821041, 0x01084421,
+  0x01111111, 0x02244891, 0x02492491, 0x04925249, 0x04a52949, 0x052a54a9,
+  0x05552aa9, 0x05555555, 0x0aaad555, 0x0ab56ad5, 0x0b5ad6b5, 0x0b6d6db5,
+  0x0db6db6d, 0x0dbb76ed, 0x0ddddddd, 0x0ef77bdd, 0x0f7defbd, 0x0fbf7efd,
+  0x0ff7fbfd, 0x0fff7ffd, 0x0ffffffd, 0x0fffffff,
+  // 29 steps
+  0x00000001, 0x00008001, 0x00100401, 0x00408101, 0x01041041, 0x02108421,
+  0x02222221, 0x04488911, 0x04922491, 0x09249249, 0x09494949, 0x0a52a529,
+  0x0aa552a9, 0x0aaaaaa9, 0x15555555, 0x155aad55, 0x15ad5ad5, 0x16b6b6b5,
+  0x16db6db5, 0x1b6ddb6d, 0x1bb776ed, 0x1ddddddd, 0x1def7bdd, 0x1efbefbd,
+  0x1fbf7efd, 0x1feffbfd, 0x1fff7ffd, 0x1ffffffd, 0x1fffffff,
+  // 30 steps
+  0x00000001, 0x00008001, 0x00100401, 0x00808101, 0x01041041, 0x02108421,
+  0x04442221, 0x08889111, 0x09124491, 0x09249249, 0x12524a49, 0x1294a529,
+  0x152a54a9, 0x1554aaa9, 0x15555555, 0x2aaad555, 0x2ad5ab55, 0x2b5ad6b5,
+  0x2dadb5b5, 0x2db6db6d, 0x36ddb76d, 0x3776eeed, 0x3bbbdddd, 0x3bdef7bd,
+  0x3df7df7d, 0x3f7efefd, 0x3fdff7fd, 0x3ffefffd, 0x3ffffffd, 0x3fffffff,
+  // 31 steps
+  0x00000001, 0x00010001, 0x00200801, 0x01010101, 0x02082081, 0x04210841,
+  0x08844221, 0x11111111, 0x12244891, 0x12492491, 0x24929249, 0x25292949,
+  0x29529529, 0x2a9552a9, 0x2aaaaaa9, 0x55555555, 0x556aad55, 0x56ad6ad5,
+  0x5ad6d6b5, 0x5b6d6db5, 0x6db6db6d, 0x6ddbb76d, 0x6eeeeeed, 0x777bbddd,
+  0x7bdef7bd, 0x7df7df7d, 0x7efefefd, 0x7fdff7fd, 0x7ffefffd, 0x7ffffffd,
+  0x7fffffff,
+  // 32 steps
+  0x00000001, 0x00010001, 0x00400801, 0x01010101, 0x04102081, 0x08410841,
+  0x10884421, 0x11111111, 0x22448911, 0x24912491, 0x49249249, 0x49494949,
+  0x5294a529, 0x54a954a9, 0x5554aaa9, 0x55555555, 0xaaab5555, 0xab55ab55,
+  0xad6b5ad5, 0xb5b5b5b5, 0xb6db6db5, 0xdb6ddb6d, 0xddbb76ed, 0xdddddddd,
+  0xef77bbdd, 0xf7bdf7bd, 0xfbefdf7d, 0xfdfdfdfd, 0xffbff7fd, 0xfffdfffd,
+  0xfffffffd, 0xffffffff,
+};
+
+#endif /* _EUCLID_PATTERNS_H_ */
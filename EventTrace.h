@@ -0,0 +1,100 @@
+#ifndef _EVENT_TRACE_H_
+#define _EVENT_TRACE_H_
+
+#include <inttypes.h>
+
+#ifndef EVENT_TRACE_SIZE
+#define EVENT_TRACE_SIZE           128 // records, must be a power of two up to 256
+#endif
+
+#define EVENT_TRACE_RESET          0
+#define EVENT_TRACE_RISE           1
+#define EVENT_TRACE_FALL           2
+#define EVENT_TRACE_TIMER          3
+
+#define EVENT_TRACE_TYPE_SHIFT     6
+#define EVENT_TRACE_PORT_MASK      0x3f
+
+/**
+ * Ring of the most recent interrupt events, for post-mortem debugging.
+ * Each record holds a 16-bit timestamp in timer ticks, from the caller's
+ * tick counter, and one byte with
+ * the event type in the top two bits and a snapshot of the six low bits of
+ * the output port. Recording is a handful of instructions and can be
+ * called from any ISR. The trace can be frozen, so that the events
+ * leading up to a glitch are kept until they have been dumped.
+ */
+class EventTrace {
+public:
+  struct Event {
+    uint16_t time;
+    uint8_t state;
+  };
+  volatile bool frozen;
+  inline void record(uint8_t type, uint8_t port, uint16_t time){
+    if(frozen)
+      return;
+    Event& e = events[head];
+    e.time = time;
+    e.state = (type << EVENT_TRACE_TYPE_SHIFT) | (port & EVENT_TRACE_PORT_MASK);
+    last = port & EVENT_TRACE_PORT_MASK;
+    if(++head == (uint8_t)EVENT_TRACE_SIZE){
+      head = 0;
+      full = true;
+    }
+  }
+  /* record only if the port has changed since the last event */
+  inline void recordChange(uint8_t type, uint8_t port, uint16_t time){
+    if((port & EVENT_TRACE_PORT_MASK) != last)
+      record(type, port, time);
+  }
+  void clear(){
+    head = 0;
+    full = false;
+    frozen = false;
+  }
+  uint16_t size(){
+    return full ? EVENT_TRACE_SIZE : head;
+  }
+  /* the i'th event, oldest first */
+  Event& get(uint16_t i){
+    if(full)
+      i += head;
+    return events[i & (EVENT_TRACE_SIZE-1)];
+  }
+#ifdef SERIAL_DEBUG
+  void dump(){
+    bool wasFrozen = frozen;
+    frozen = true;
+    uint16_t count = size();
+    for(uint16_t i=0; i<count; ++i){
+      Event& e = get(i);
+      printInteger(e.time);
+      switch(e.state >> EVENT_TRACE_TYPE_SHIFT){
+      case EVENT_TRACE_RESET:
+	printString(" reset ");
+	break;
+      case EVENT_TRACE_RISE:
+	printString(" rise ");
+	break;
+      case EVENT_TRACE_FALL:
+	printString(" fall ");
+	break;
+      case EVENT_TRACE_TIMER:
+	printString(" timer ");
+	break;
+      }
+      printBinary(e.state & EVENT_TRACE_PORT_MASK);
+      printNewline();
+    }
+    frozen = wasFrozen;
+  }
+#endif
+private:
+  Event events[EVENT_TRACE_SIZE];
+  uint8_t head;
+  uint8_t last;
+  bool full;
+};
+
+#endif /* _EVENT_TRACE_H_ */
@@ -0,0 +1,77 @@
+#ifndef _INTERVAL_RING_H_
+#define _INTERVAL_RING_H_
+
+#include <inttypes.h>
+
+#ifndef INTERVAL_RING_SIZE
+#define INTERVAL_RING_SIZE         256 // bytes
+#endif
+
+/**
+ * Recording of the intervals between clock onsets, in timer ticks, played
+ * back in a loop. Each interval is stored as its difference from the one
+ * before, modulo 2^16 and zigzag encoded so that small changes either way
+ * are small numbers, in one to three bytes: seven bits per byte with the
+ * top bit set if another byte follows, and the last two bits in the third.
+ * A steady clock takes one byte per onset, whatever its rate.
+ * Decoding is three byte reads at most, with no loop, so next() takes
+ * constant time and can be called from the timer interrupt.
+ */
+class IntervalRing {
+public:
+  uint8_t data[INTERVAL_RING_SIZE];
+  uint16_t length; // bytes recorded
+  uint16_t read;
+  uint16_t previous; // the last interval written or read
+  IntervalRing() : length(0), read(0), previous(0) {}
+  void clear(){
+    length = 0;
+    rewind();
+  }
+  /* false if the interval does not fit */
+  bool write(uint16_t interval){
+    int16_t delta = interval - previous;
+    uint16_t z = ((uint16_t)delta << 1) ^ (uint16_t)(delta >> 15);
+    uint8_t bytes = z < 0x80 ? 1 : z < 0x4000 ? 2 : 3;
+    if(length + bytes > INTERVAL_RING_SIZE)
+      return false;
+    if(bytes == 1){
+      data[length++] = z;
+    }else{
+      data[length++] = z | 0x80;
+      if(bytes == 2){
+	data[length++] = z >> 7;
+      }else{
+	data[length++] = (z >> 7) | 0x80;
+	data[length++] = z >> 14;
+      }
+    }
+    previous = interval;
+    return true;
+  }
+  /* back to the first interval, for playing */
+  void rewind(){
+    read = 0;
+    previous = 0;
+  }
+  /* the next interval, from the first again after the last */
+  inline uint16_t next(){
+    if(read >= length)
+      rewind();
+    uint8_t b = data[read++];
+    uint16_t z = b & 0x7f;
+    if(b & 0x80){
+      b = data[read++];
+      z |= (uint16_t)(b & 0x7f) << 7;
+      if(b & 0x80)
+	z |= (uint16_t)data[read++] << 14;
+    }
+    previous += (z >> 1) ^ -(z & 1);
+    return previous;
+  }
+  inline bool isEmpty(){
+    return length == 0;
+  }
+};
+
+#endif /* _INTERVAL_RING_H_ */
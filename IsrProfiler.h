@@ -0,0 +1,72 @@
+#ifndef _ISR_PROFILER_H_
+#define _ISR_PROFILER_H_
+
+#include <inttypes.h>
+#include <avr/io.h>
+#include "device.h"
+
+/**
+ * Interrupt service routine cycle counter.
+ * With ISR_PROFILE defined, Timer 1 runs free at the CPU clock and each
+ * profiled ISR reads it on entry and exit. Min, max, mean and count are
+ * kept per vector. Min and max cover every call, the mean only the first
+ * 65535 after a reset. The figures exclude the compiler generated
+ * prologue and epilogue, and include the few cycles spent reading the
+ * counter.
+ * Without ISR_PROFILE the macros compile to nothing.
+ */
+
+#define ISR_PROFILE_INT1           0
+#define ISR_PROFILE_TIMER0         1
+#define ISR_PROFILE_ADC            2
+#define ISR_PROFILE_VECTORS        3
+
+#ifdef ISR_PROFILE
+
+class IsrProfile {
+public:
+  uint16_t min;
+  uint16_t max;
+  uint32_t total;
+  uint16_t count;
+  inline void add(uint16_t cycles){
+    if(cycles < min)
+      min = cycles;
+    if(cycles > max)
+      max = cycles;
+    if(count == 0xffff)
+      return; // saturated, the mean is of the first 65535
+    count++;
+    total += cycles;
+  }
+  void reset(){
+    min = 0xffff;
+    max = 0;
+    total = 0;
+    count = 0;
+  }
+  uint16_t mean(){
+    return count ? total/count : 0;
+  }
+};
+
+extern DEVICE_STATE IsrProfile isrProfiles[ISR_PROFILE_VECTORS];
+
+inline void setup_profiler(){
+  TCCR1A = 0;
+  TCCR1B = _BV(CS10); // no prescaler, normal mode: counts CPU cycles
+  for(uint8_t i=0; i<ISR_PROFILE_VECTORS; ++i)
+    isrProfiles[i].reset();
+}
+
+#define PROFILE_ENTER() uint16_t profileStart = TCNT1
+#define PROFILE_EXIT(vector) isrProfiles[vector].add(TCNT1 - profileStart)
+
+#else
+
+#define PROFILE_ENTER()
+#define PROFILE_EXIT(vector)
+
+#endif /* ISR_PROFILE */
+
+#endif /* _ISR_PROFILER_H_ */
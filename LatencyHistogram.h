@@ -0,0 +1,53 @@
+#ifndef _LATENCY_HISTOGRAM_H_
+#define _LATENCY_HISTOGRAM_H_
+
+#include <inttypes.h>
+
+#ifndef LATENCY_BINS
+#define LATENCY_BINS               32
+#endif
+#ifndef LATENCY_BIN_SHIFT
+#define LATENCY_BIN_SHIFT          4 // bin width of 16 timer counts, 8us at 16MHz
+#endif
+#define LATENCY_BIN_ORIGIN         (LATENCY_BINS/2)
+
+/**
+ * Histogram of output edge timing errors.
+ * Values are signed deviations from the ideal output time, in Timer 0
+ * counts (0.5us at 16MHz with prescaler 8). Bin LATENCY_BIN_ORIGIN holds
+ * deviations from 0 up to one bin width; the first and last bins also
+ * collect everything out of range. The exact extremes are kept in min and max.
+ */
+class LatencyHistogram {
+public:
+  int16_t min;
+  int16_t max;
+  uint16_t bins[LATENCY_BINS];
+  inline void add(int16_t t){
+    int16_t bin = (t >> LATENCY_BIN_SHIFT) + LATENCY_BIN_ORIGIN;
+    if(bin < 0)
+      bin = 0;
+    else if(bin >= LATENCY_BINS)
+      bin = LATENCY_BINS-1;
+    if(bins[bin] != 0xffff)
+      bins[bin]++;
+    if(t < min)
+      min = t;
+    if(t > max)
+      max = t;
+  }
+  uint32_t count(){
+    uint32_t n = 0;
+    for(uint8_t i=0; i<LATENCY_BINS; ++i)
+      n += bins[i];
+    return n;
+  }
+  void reset(){
+    min = 0x7fff;
+    max = -0x7fff;
+    for(uint8_t i=0; i<LATENCY_BINS; ++i)
+      bins[i] = 0;
+  }
+};
+
+#endif /* _LATENCY_HISTOGRAM_H_ */
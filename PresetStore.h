@@ -0,0 +1,126 @@
+#ifndef _PRESET_STORE_H_
+#define _PRESET_STORE_H_
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <string.h>
+#include <avr/io.h>
+#include <avr/eeprom.h>
+#include <util/crc16.h>
+
+#define PRESET_VERSION             3
+#ifndef PRESET_HOLDOFF_TICKS
+#define PRESET_HOLDOFF_TICKS       7812 // one second of Timer 0 overflows
+#endif
+
+/* settings kept across power cycles */
+struct Preset {
+  uint8_t flags; // which of the settings below are set
+  uint8_t mode;
+  int8_t divider;
+  uint8_t counter;
+  uint16_t delay;
+  uint8_t lossPeriods;
+  uint16_t gate;
+};
+
+/* 12 bytes on the AVR, which does not pad: a 9 byte preset in 3 bytes of framing */
+struct PresetRecord {
+  uint8_t sequence;
+  uint8_t version;
+  Preset preset;
+  uint8_t crc; // of all the bytes above
+};
+
+/* 85 in the 1k bytes of the ATmega328, fewer than the 128 the sequence numbers allow */
+#define PRESET_SLOTS               ((E2END+1)/sizeof(PresetRecord))
+
+/**
+ * Wear levelled ring of preset records filling the EEPROM. Each save
+ * goes to the slot after the newest record, with the next sequence
+ * number, so that all slots wear evenly. A record whose version or CRC
+ * does not match is ignored: a write cut short by power loss leaves the
+ * previous record as the newest.
+ * Restoring reads every slot once, about 1k bytes, in bounded time.
+ * Saving is deferred until the preset has not changed for
+ * PRESET_HOLDOFF_TICKS, so that a burst of changes is one write, and
+ * service() writes one byte per call, only when the EEPROM is ready.
+ * Neither the main loop nor an interrupt waits for the 3.3ms write cycle.
+ */
+class PresetStore {
+public:
+  /* the newest valid record, false if there is none and preset keeps its defaults */
+  bool restore(Preset& preset){
+    bool found = false;
+    slot = PRESET_SLOTS-1;
+    sequence = 0;
+    for(uint8_t i=0; i<PRESET_SLOTS; ++i){
+      PresetRecord r;
+      eeprom_read_block(&r, address(i), sizeof(r));
+      if(r.version != PRESET_VERSION || r.crc != crc(r))
+	continue;
+      // newer in serial number order: the ring holds fewer than 128 records
+      if(!found || (int8_t)(r.sequence - sequence) > 0){
+	found = true;
+	slot = i;
+	sequence = r.sequence;
+	preset = r.preset;
+      }
+    }
+    pending = preset;
+    written = sizeof(record);
+    dirty = false;
+    return found;
+  }
+  /* remember the preset, to be written once it stays unchanged */
+  void save(const Preset& preset, uint16_t now){
+    if(memcmp(&preset, &pending, sizeof(pending)) != 0){
+      pending = preset;
+      changedAt = now;
+      dirty = true;
+    }
+  }
+  /* call from the main loop, with the time in timer ticks */
+  void service(uint16_t now){
+    if(written < sizeof(record)){
+      if(eeprom_is_ready()){
+	eeprom_update_byte(address(slot)+written, ((uint8_t*)&record)[written]);
+	written++;
+      }
+    }else if(dirty && (uint16_t)(now - changedAt) >= PRESET_HOLDOFF_TICKS){
+      dirty = false;
+      if(++slot == PRESET_SLOTS)
+	slot = 0;
+      record.sequence = ++sequence;
+      record.version = PRESET_VERSION;
+      record.preset = pending;
+      record.crc = crc(record);
+      written = 0;
+    }
+  }
+  /* a preset is waiting to be written, or being written */
+  bool isPending(){
+    return dirty || written < sizeof(record);
+  }
+private:
+  uint8_t slot; // of the newest record
+  uint8_t sequence;
+  uint8_t written; // bytes of the record written so far
+  bool dirty;
+  uint16_t changedAt;
+  Preset pending;
+  PresetRecord record;
+
+  static uint8_t* address(uint8_t slot){
+    return (uint8_t*)(uintptr_t)(slot*sizeof(PresetRecord));
+  }
+  static uint8_t crc(const PresetRecord& r){
+    const uint8_t* data = (const uint8_t*)&r;
+    uint8_t c = 0;
+    for(uint8_t i=0; i<offsetof(PresetRecord, crc); ++i)
+      c = _crc8_ccitt_update(c, data[i]);
+    return c;
+  }
+};
+
+#endif /* _PRESET_STORE_H_ */
@@ -0,0 +1,234 @@
+#ifndef _SERIAL_COMMAND_H_
+#define _SERIAL_COMMAND_H_
+
+#include <inttypes.h>
+
+/**
+ * Line based remote control protocol.
+ * A frame is one line of commands, terminated by a newline, eg:
+ *   D7 C3 T205 M1 R P16 S63
+ * Each command is an upper case letter followed by an optional decimal
+ * argument. The whole frame is parsed before anything is applied, so that
+ * a frame is either applied completely or, if any command in it is
+ * malformed, rejected completely.
+ *
+ *   D<n>  set divider value, -1 to 127
+ *   C<n>  set counter value, 0 to 255
+ *   T<n>  set delay in timer ticks, 1 to 65535
+ *   M<n>  select operating mode, see OperatingMode
+ *   L     return divider, counter, delay and mode to local (knob and switch) control
+ *   W<n>  quiesce the outputs when no clock has risen for n periods, 0 never
+ *   G<n>  delay and counter output pulses of n timer ticks, 0 as long as the clock pulse
+ *   E<n>  seed the random numbers that skip pulses in chance mode, 1 to 65535
+ *   A<n>  1 to arm the looper, recording from the next clock, 0 to stop recording and play
+ *   R     reset all outputs and counters
+ *   P<n>  inject n clock pulses, 1 to COMMAND_MAX_PULSES, default 1
+ *   S<n>  report the status fields in bit mask n, default all except instrumentation
+ *   F     freeze the event trace
+ *   Z<n>  clear the instrumentation in bit mask n, default all
+ */
+
+#define SERIAL_COMMAND_LINE_LENGTH  32
+#define COMMAND_MAX_PULSES          256 // bounds the time loop() spends injecting
+
+#define COMMAND_DIVIDER             _BV(0)
+#define COMMAND_COUNTER             _BV(1)
+#define COMMAND_DELAY               _BV(2)
+#define COMMAND_MODE                _BV(3)
+#define COMMAND_LOCAL               _BV(4)
+#define COMMAND_RESET               _BV(5)
+#define COMMAND_PULSES              _BV(6)
+#define COMMAND_STATUS              _BV(7)
+#define COMMAND_FREEZE              _BV(8)
+#define COMMAND_CLEAR               _BV(9)
+#define COMMAND_WATCHDOG            _BV(10)
+#define COMMAND_GATE                _BV(11)
+#define COMMAND_SEED                _BV(12)
+#define COMMAND_LOOP                _BV(13)
+
+#define STATUS_DIVIDER              _BV(0)
+#define STATUS_COUNTER              _BV(1)
+#define STATUS_DELAY                _BV(2)
+#define STATUS_SWING                _BV(3)
+#define STATUS_OUTPUTS              _BV(4)
+#define STATUS_MODE                 _BV(5)
+#define STATUS_ALL                  0x3f
+#define STATUS_TRACE                _BV(6)
+#define STATUS_PROFILE              _BV(7)
+#define STATUS_LATENCY              _BV(8)
+#define STATUS_STACK                _BV(9)
+#define STATUS_BOOT                 _BV(10)
+
+class SerialCommand {
+public:
+  uint16_t flags;
+  int8_t divider;
+  uint8_t counter;
+  uint16_t delay;
+  uint8_t mode;
+  uint16_t pulses;
+  uint16_t status;
+  uint16_t clear;
+  uint8_t lossPeriods;
+  uint16_t gate;
+  uint16_t seed;
+  uint8_t loop;
+};
+
+class SerialCommandParser {
+public:
+  enum Result {
+    INCOMPLETE = 0,
+    COMPLETE,
+    MALFORMED
+  };
+  SerialCommandParser() : length(0), overflow(false) {}
+  inline bool isEmpty(){
+    return length == 0;
+  }
+  /* feed one received byte, returns COMPLETE when cmd holds a new frame */
+  Result receive(char c, SerialCommand& cmd){
+    if(c == '\r' || c == '\n'){
+      if(length == 0 && !overflow)
+	return INCOMPLETE; // ignore empty lines
+      Result result = overflow ? MALFORMED : parse(cmd);
+      length = 0;
+      overflow = false;
+      return result;
+    }
+    if(length < SERIAL_COMMAND_LINE_LENGTH)
+      line[length++] = c;
+    else
+      overflow = true;
+    return INCOMPLETE;
+  }
+private:
+  char line[SERIAL_COMMAND_LINE_LENGTH];
+  uint8_t length;
+  bool overflow;
+  bool number(uint8_t& i, int32_t min, int32_t max, int32_t& value){
+    bool negative = false;
+    if(i < length && line[i] == '-'){
+      negative = true;
+      i++;
+    }
+    if(i == length || line[i] < '0' || line[i] > '9')
+      return false;
+    int32_t v = 0;
+    while(i < length && line[i] >= '0' && line[i] <= '9'){
+      v = v*10 + line[i++] - '0';
+      if(v > 65535)
+	return false;
+    }
+    if(negative)
+      v = -v;
+    if(v < min || v > max)
+      return false;
+    value = v;
+    return true;
+  }
+  bool optional(uint8_t& i, int32_t min, int32_t max, int32_t& value){
+    if(i < length && line[i] != ' ')
+      return number(i, min, max, value);
+    return true; // keep default
+  }
+  Result parse(SerialCommand& cmd){
+    SerialCommand frame;
+    frame.flags = 0;
+    uint8_t i = 0;
+    while(i < length){
+      char c = line[i++];
+      int32_t v;
+      switch(c){
+      case ' ':
+	continue;
+      case 'D':
+	if(!number(i, -1, 127, v))
+	  return MALFORMED;
+	frame.divider = v;
+	frame.flags |= COMMAND_DIVIDER;
+	break;
+      case 'C':
+	if(!number(i, 0, 255, v))
+	  return MALFORMED;
+	frame.counter = v;
+	frame.flags |= COMMAND_COUNTER;
+	break;
+      case 'T':
+	if(!number(i, 1, 65535, v))
+	  return MALFORMED;
+	frame.delay = v;
+	frame.flags |= COMMAND_DELAY;
+	break;
+      case 'M':
+	if(!number(i, 0, 255, v))
+	  return MALFORMED;
+	frame.mode = v;
+	frame.flags |= COMMAND_MODE;
+	break;
+      case 'L':
+	frame.flags |= COMMAND_LOCAL;
+	break;
+      case 'W':
+	if(!number(i, 0, 255, v))
+	  return MALFORMED;
+	frame.lossPeriods = v;
+	frame.flags |= COMMAND_WATCHDOG;
+	break;
+      case 'G':
+	if(!number(i, 0, 65535, v))
+	  return MALFORMED;
+	frame.gate = v;
+	frame.flags |= COMMAND_GATE;
+	break;
+      case 'E':
+	if(!number(i, 1, 65535, v))
+	  return MALFORMED;
+	frame.seed = v;
+	frame.flags |= COMMAND_SEED;
+	break;
+      case 'A':
+	if(!number(i, 0, 1, v))
+	  return MALFORMED;
+	frame.loop = v;
+	frame.flags |= COMMAND_LOOP;
+	break;
+      case 'R':
+	frame.flags |= COMMAND_RESET;
+	break;
+      case 'P':
+	v = 1;
+	if(!optional(i, 1, COMMAND_MAX_PULSES, v))
+	  return MALFORMED;
+	frame.pulses = v;
+	frame.flags |= COMMAND_PULSES;
+	break;
+      case 'S':
+	v = STATUS_ALL;
+	if(!optional(i, 0, 65535, v))
+	  return MALFORMED;
+	frame.status = v;
+	frame.flags |= COMMAND_STATUS;
+	break;
+      case 'F':
+	frame.flags |= COMMAND_FREEZE;
+	break;
+      case 'Z':
+	v = 0xffff;
+	if(!optional(i, 0, 65535, v))
+	  return MALFORMED;
+	frame.clear = v;
+	frame.flags |= COMMAND_CLEAR;
+	break;
+      default:
+	return MALFORMED;
+      }
+      if(i < length && line[i] != ' ')
+	return MALFORMED;
+    }
+    cmd = frame;
+    return COMPLETE;
+  }
+};
+
+#endif /* _SERIAL_COMMAND_H_ */
@@ -0,0 +1,58 @@
+#include "StackMonitor.h"
+
+#ifdef STACK_MONITOR
+
+#include <avr/io.h>
+
+extern uint8_t __data_start;
+extern uint8_t _end;
+extern uint8_t __stack;
+
+// runs before the C runtime sets up the stack pointer and clears bss, so
+// it must not use the stack
+void paintStack() __attribute__ ((naked, used, section (".init1")));
+
+void paintStack(){
+  asm volatile ("    ldi r30,lo8(_end)\n"
+		"    ldi r31,hi8(_end)\n"
+		"    ldi r24,%0\n"
+		"    ldi r25,hi8(__stack)\n"
+		"    rjmp 2f\n"
+		"1:\n"
+		"    st Z+,r24\n"
+		"2:\n"
+		"    cpi r30,lo8(__stack)\n"
+		"    cpc r31,r25\n"
+		"    brlo 1b\n"
+		"    breq 1b\n"
+		:: "M" (STACK_CANARY));
+}
+
+uint16_t staticSize(){
+  return &_end - &__data_start;
+}
+
+uint16_t stackUnused(){
+  const uint8_t* p = &_end;
+  while(p <= &__stack && *p == STACK_CANARY)
+    p++;
+  return p - &_end;
+}
+
+uint16_t stackUsed(){
+  return &__stack - &_end + 1 - stackUnused();
+}
+
+uint16_t stackFree(){
+  return (uint8_t*)SP - &_end;
+}
+
+void stackRepaint(){
+  uint8_t* p = &_end;
+  // leave a margin for this function's own stack frame
+  uint8_t* top = (uint8_t*)SP - 16;
+  while(p < top)
+    *p++ = STACK_CANARY;
+}
+
+#endif /* STACK_MONITOR */
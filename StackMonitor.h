@@ -0,0 +1,28 @@
+#ifndef _STACK_MONITOR_H_
+#define _STACK_MONITOR_H_
+
+#include <inttypes.h>
+
+/**
+ * Stack high water mark.
+ * With STACK_MONITOR defined, all RAM above the static data is filled
+ * with a canary byte at boot, before any other initialisation. The stack
+ * grows down from RAMEND and overwrites the canary, so the lowest
+ * overwritten address marks the deepest excursion since boot.
+ */
+
+#define STACK_CANARY               0xc5
+
+/* bytes of static data and bss */
+uint16_t staticSize();
+/* the most bytes of stack ever used */
+uint16_t stackUsed();
+/* bytes never touched, between the end of static data and the deepest stack excursion */
+uint16_t stackUnused();
+/* bytes currently free between the end of static data and the stack pointer */
+uint16_t stackFree();
+/* paint free RAM again, below the current stack pointer, to restart the
+   measurement. Must be called with interrupts disabled. */
+void stackRepaint();
+
+#endif /* _STACK_MONITOR_H_ */
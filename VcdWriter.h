@@ -0,0 +1,151 @@
+#ifndef _VCD_WRITER_H_
+#define _VCD_WRITER_H_
+
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+
+#ifndef VCD_MAX_SIGNALS
+#define VCD_MAX_SIGNALS            32
+#endif
+#define VCD_BUFFER_SIZE            (256*1024)
+
+/**
+ * Value Change Dump writer, for viewing simulation runs in eg GTKWave.
+ * Output is formatted by hand into a large buffer which is written out
+ * only when full, and a value is written only when it differs from the
+ * last one written for that signal, so that tracing long runs is cheap.
+ * Times are in nanoseconds.
+ */
+class VcdWriter {
+public:
+  VcdWriter() : file(NULL), signals(0), length(0), time(0), stamped(false), started(false) {}
+  ~VcdWriter(){
+    close();
+  }
+  bool open(const char* filename){
+    file = fopen(filename, "w");
+    return file != NULL;
+  }
+  bool isOpen(){
+    return file != NULL;
+  }
+  /* declare a signal before the first sample, returns its index */
+  int add(const char* name, uint8_t width = 1){
+    if(signals == VCD_MAX_SIGNALS || started)
+      return -1;
+    Signal& s = signal[signals];
+    strncpy(s.name, name, sizeof(s.name)-1);
+    s.name[sizeof(s.name)-1] = '\0';
+    s.width = width;
+    s.id[0] = '!' + signals;
+    s.id[1] = '\0';
+    s.value = 0;
+    s.known = false;
+    return signals++;
+  }
+  /* set the time for the following changes, which must not go backwards */
+  void at(uint64_t t){
+    if(!started)
+      start();
+    if(t != time){
+      time = t;
+      stamped = false;
+    }
+  }
+  void set(int index, uint32_t value){
+    Signal& s = signal[index];
+    if(s.known && s.value == value)
+      return;
+    s.value = value;
+    s.known = true;
+    if(!stamped){
+      append('#');
+      append(time);
+      append('\n');
+      stamped = true;
+    }
+    write(s);
+  }
+  void flush(){
+    if(file != NULL && length > 0)
+      fwrite(buffer, 1, length, file);
+    length = 0;
+  }
+  void close(){
+    if(file != NULL){
+      if(!started)
+	start();
+      flush();
+      fclose(file);
+      file = NULL;
+    }
+  }
+private:
+  struct Signal {
+    char name[32];
+    char id[2];
+    uint8_t width;
+    uint32_t value;
+    bool known;
+  };
+  FILE* file;
+  Signal signal[VCD_MAX_SIGNALS];
+  int signals;
+  char buffer[VCD_BUFFER_SIZE];
+  size_t length;
+  uint64_t time;
+  bool stamped;
+  bool started;
+
+  void start(){
+    started = true;
+    append("$timescale 1ns $end\n$scope module clockdelay $end\n");
+    for(int i=0; i<signals; ++i){
+      append("$var wire ");
+      append((uint64_t)signal[i].width);
+      append(' ');
+      append(signal[i].id);
+      append(' ');
+      append(signal[i].name);
+      append(" $end\n");
+    }
+    append("$upscope $end\n$enddefinitions $end\n");
+  }
+  void write(Signal& s){
+    if(s.width == 1){
+      append(s.value ? '1' : '0');
+    }else{
+      append('b');
+      int bit = s.width-1;
+      while(bit > 0 && !(s.value & (1UL << bit)))
+	bit--; // skip leading zeros
+      for(; bit >= 0; --bit)
+	append(s.value & (1UL << bit) ? '1' : '0');
+      append(' ');
+    }
+    append(s.id);
+    append('\n');
+  }
+  inline void append(char c){
+    if(length == VCD_BUFFER_SIZE)
+      flush();
+    buffer[length++] = c;
+  }
+  void append(const char* s){
+    while(*s)
+      append(*s++);
+  }
+  void append(uint64_t n){
+    char digits[20];
+    int i = 0;
+    do{
+      digits[i++] = '0' + n % 10;
+      n /= 10;
+    }while(n > 0);
+    while(i > 0)
+      append(digits[--i]);
+  }
+};
+
+#endif /* _VCD_WRITER_H_ */
@@ -1,10 +1,26 @@
 #include "adc_freerunner.h"
 
 #include <avr/interrupt.h> 
+#include "IsrProfiler.h"
 
-uint16_t volatile adc_values[ADC_CHANNELS];
+DEVICE_STATE uint16_t volatile adc_values[ADC_CHANNELS];
+DEVICE_STATE bool volatile adc_ready;
+
+static DEVICE_STATE uint8_t oldchan;
+static DEVICE_STATE uint8_t counter;
+static DEVICE_STATE uint16_t adc_buffer[ADC_CHANNELS];
+// the first frame is dropped: it has an extra sample of channel 0,
+// converted before the first interrupt could select the next channel
+static DEVICE_STATE bool first_frame;
 
 void setup_adc(){
+   adc_ready = false;
+   first_frame = true;
+   oldchan = 0;
+   counter = 0;
+   for(uint8_t i=0; i<ADC_CHANNELS; ++i)
+     adc_buffer[i] = 0;
+   ADMUX &= ~7; // start from channel 0
    ADCSRA |= (1 << ADPS2) | (1 << ADPS1) | (1 << ADPS0); // Set ADC prescaler to 128 - 125KHz sample rate @ 16MHz
 
    ADMUX |= (1 << REFS0); // Set ADC reference to AVCC
@@ -24,9 +40,7 @@ void setup_adc(){
 }
 
 ISR(ADC_vect) {
-  static uint8_t oldchan;
-  static uint8_t counter;
-  static uint16_t adc_buffer[ADC_CHANNELS];
+  PROFILE_ENTER();
   uint8_t curchan = ADMUX & 7;
   adc_buffer[oldchan] += ADCL | (ADCH << 8);
   oldchan = curchan;
@@ -35,10 +49,14 @@ ISR(ADC_vect) {
     if(++counter == ADC_OVERSAMPLING){
       counter = 0;
       for(uint8_t i=0; i<ADC_CHANNELS; ++i){
-	adc_values[i] = adc_buffer[i];
+	if(!first_frame)
+	  adc_values[i] = adc_buffer[i];
 	adc_buffer[i] = 0;
       }
+      adc_ready = !first_frame;
+      first_frame = false;
     }
   }
   ADMUX = (ADMUX & ~7) | curchan;
+  PROFILE_EXIT(ISR_PROFILE_ADC);
 }
@@ -2,9 +2,12 @@
 #define _ANALOGREADER_H_
 
 #include <inttypes.h>
+#include <avr/io.h>
 #include "device.h"
 
-extern uint16_t volatile adc_values[ADC_CHANNELS];
+extern DEVICE_STATE uint16_t volatile adc_values[ADC_CHANNELS];
+/* adc_values holds a complete frame: 2*ADC_CHANNELS*ADC_OVERSAMPLING conversions, 1.7ms, after setup_adc() */
+extern DEVICE_STATE bool volatile adc_ready;
 
 void setup_adc();
 
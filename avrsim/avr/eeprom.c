@@ -0,0 +1,31 @@
+#include <string.h>
+#include "avr/eeprom.h"
+
+DEVICE_STATE uint8_t sim_eeprom[E2END+1];
+DEVICE_STATE uint32_t sim_eeprom_writes;
+
+void sim_eeprom_erase(void){
+  memset(sim_eeprom, 0xff, sizeof(sim_eeprom));
+  sim_eeprom_writes = 0;
+}
+
+uint8_t eeprom_read_byte(const uint8_t* address){
+  return sim_eeprom[(size_t)address & E2END];
+}
+
+void eeprom_read_block(void* dst, const void* src, size_t n){
+  uint8_t* d = (uint8_t*)dst;
+  size_t a = (size_t)src;
+  while(n--)
+    *d++ = sim_eeprom[a++ & E2END];
+}
+
+void eeprom_write_byte(uint8_t* address, uint8_t value){
+  sim_eeprom[(size_t)address & E2END] = value;
+  sim_eeprom_writes++;
+}
+
+void eeprom_update_byte(uint8_t* address, uint8_t value){
+  if(eeprom_read_byte(address) != value)
+    eeprom_write_byte(address, value);
+}
@@ -0,0 +1,35 @@
+#ifndef _AVRSIM_EEPROM_H_
+#define _AVRSIM_EEPROM_H_
+
+#include <stddef.h>
+#include "avr/io.h"
+
+/*
+  Host side stand-in for <avr/eeprom.h>.
+  The EEPROM is a byte array, which the tests can inspect and corrupt.
+  Writes complete at once, so the EEPROM is always ready.
+ */
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+extern DEVICE_STATE uint8_t sim_eeprom[E2END+1];
+/* number of bytes written, by eeprom_write_byte or a changing update */
+extern DEVICE_STATE uint32_t sim_eeprom_writes;
+/* erased EEPROM reads 0xff */
+void sim_eeprom_erase(void);
+
+uint8_t eeprom_read_byte(const uint8_t* address);
+void eeprom_read_block(void* dst, const void* src, size_t n);
+void eeprom_write_byte(uint8_t* address, uint8_t value);
+void eeprom_update_byte(uint8_t* address, uint8_t value);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#define eeprom_is_ready() 1
+#define eeprom_busy_wait()
+
+#endif /* _AVRSIM_EEPROM_H_ */
@@ -0,0 +1,38 @@
+#ifndef _AVRSIM_INTERRUPT_H_
+#define _AVRSIM_INTERRUPT_H_
+
+#include "avr/io.h"
+
+/*
+  Host side stand-in for <avr/interrupt.h>.
+  Interrupt vectors become plain functions which the tests and the
+  simulator call directly. cli() and sei() only track the I flag in SREG.
+ */
+
+#define SREG_I 7
+
+#define sei() (SREG |= _BV(SREG_I))
+#define cli() (SREG &= ~_BV(SREG_I))
+#define interruptsEnabled() (SREG & _BV(SREG_I))
+
+#ifdef __cplusplus
+#define ISR(vector, ...) extern "C" void vector(void)
+#else
+#define ISR(vector, ...) void vector(void)
+#endif
+#define SIGNAL(vector) ISR(vector)
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+void INT0_vect(void);
+void INT1_vect(void);
+void TIMER0_OVF_vect(void);
+void ADC_vect(void);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif /* _AVRSIM_INTERRUPT_H_ */
@@ -0,0 +1,38 @@
+#include "avr/io.h"
+
+DEVICE_STATE volatile uint8_t sim_portb;
+DEVICE_STATE volatile uint8_t sim_portc;
+DEVICE_STATE volatile uint8_t sim_portd;
+DEVICE_STATE volatile uint8_t sim_ddrb;
+DEVICE_STATE volatile uint8_t sim_ddrc;
+DEVICE_STATE volatile uint8_t sim_ddrd;
+
+DEVICE_STATE volatile uint8_t SREG;
+
+DEVICE_STATE volatile uint8_t EICRA;
+DEVICE_STATE volatile uint8_t EIMSK;
+DEVICE_STATE volatile uint8_t EIFR;
+
+DEVICE_STATE volatile uint8_t TCCR0A;
+DEVICE_STATE volatile uint8_t TCCR0B;
+DEVICE_STATE volatile uint8_t TCNT0;
+DEVICE_STATE volatile uint8_t TIMSK0;
+DEVICE_STATE volatile uint8_t TIFR0;
+
+DEVICE_STATE volatile uint8_t TCCR1A;
+DEVICE_STATE volatile uint8_t TCCR1B;
+DEVICE_STATE volatile uint16_t TCNT1;
+DEVICE_STATE volatile uint8_t TIMSK1;
+DEVICE_STATE volatile uint8_t TIFR1;
+
+DEVICE_STATE volatile uint8_t ADCSRA;
+DEVICE_STATE volatile uint8_t ADMUX;
+DEVICE_STATE volatile uint8_t ADCL;
+DEVICE_STATE volatile uint8_t ADCH;
+
+DEVICE_STATE volatile uint8_t UCSR0A;
+DEVICE_STATE volatile uint8_t UCSR0B;
+DEVICE_STATE volatile uint8_t UCSR0C;
+DEVICE_STATE volatile uint8_t UBRR0H;
+DEVICE_STATE volatile uint8_t UBRR0L;
+DEVICE_STATE volatile uint8_t UDR0;
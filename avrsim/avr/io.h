@@ -0,0 +1,171 @@
+#ifndef _AVRSIM_IO_H_
+#define _AVRSIM_IO_H_
+
+#include <inttypes.h>
+
+/*
+  Host side stand-in for <avr/io.h>.
+  Only the ATmega328 registers and bits used by this project are defined.
+  Each PINx register aliases its PORTx register, so that writing to an
+  output port can be read back from the pins, and input pins can be
+  driven by writing to PINx.
+ */
+
+/*
+  With AVRSIM_THREADS every thread has its own device: the registers and
+  the state of the firmware are declared DEVICE_STATE, thread local.
+ */
+#ifdef AVRSIM_THREADS
+#ifdef __cplusplus
+#define DEVICE_STATE thread_local
+#else
+#define DEVICE_STATE _Thread_local
+#endif
+#else
+#define DEVICE_STATE
+#endif
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+extern DEVICE_STATE volatile uint8_t sim_portb;
+extern DEVICE_STATE volatile uint8_t sim_portc;
+extern DEVICE_STATE volatile uint8_t sim_portd;
+extern DEVICE_STATE volatile uint8_t sim_ddrb;
+extern DEVICE_STATE volatile uint8_t sim_ddrc;
+extern DEVICE_STATE volatile uint8_t sim_ddrd;
+
+extern DEVICE_STATE volatile uint8_t SREG;
+
+extern DEVICE_STATE volatile uint8_t EICRA;
+extern DEVICE_STATE volatile uint8_t EIMSK;
+extern DEVICE_STATE volatile uint8_t EIFR;
+
+extern DEVICE_STATE volatile uint8_t TCCR0A;
+extern DEVICE_STATE volatile uint8_t TCCR0B;
+extern DEVICE_STATE volatile uint8_t TCNT0;
+extern DEVICE_STATE volatile uint8_t TIMSK0;
+extern DEVICE_STATE volatile uint8_t TIFR0;
+
+extern DEVICE_STATE volatile uint8_t TCCR1A;
+extern DEVICE_STATE volatile uint8_t TCCR1B;
+extern DEVICE_STATE volatile uint16_t TCNT1;
+extern DEVICE_STATE volatile uint8_t TIMSK1;
+extern DEVICE_STATE volatile uint8_t TIFR1;
+
+extern DEVICE_STATE volatile uint8_t ADCSRA;
+extern DEVICE_STATE volatile uint8_t ADMUX;
+extern DEVICE_STATE volatile uint8_t ADCL;
+extern DEVICE_STATE volatile uint8_t ADCH;
+
+extern DEVICE_STATE volatile uint8_t UCSR0A;
+extern DEVICE_STATE volatile uint8_t UCSR0B;
+extern DEVICE_STATE volatile uint8_t UCSR0C;
+extern DEVICE_STATE volatile uint8_t UBRR0H;
+extern DEVICE_STATE volatile uint8_t UBRR0L;
+extern DEVICE_STATE volatile uint8_t UDR0;
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#define PINB   sim_portb
+#define PORTB  sim_portb
+#define DDRB   sim_ddrb
+#define PINC   sim_portc
+#define PORTC  sim_portc
+#define DDRC   sim_ddrc
+#define PIND   sim_portd
+#define PORTD  sim_portd
+#define DDRD   sim_ddrd
+
+#define PORTB0 0
+#define PORTB1 1
+#define PORTB2 2
+#define PORTB3 3
+#define PORTB4 4
+#define PORTB5 5
+#define PORTB6 6
+#define PORTB7 7
+
+#define PORTC0 0
+#define PORTC1 1
+#define PORTC2 2
+#define PORTC3 3
+#define PORTC4 4
+#define PORTC5 5
+#define PORTC6 6
+
+#define PORTD0 0
+#define PORTD1 1
+#define PORTD2 2
+#define PORTD3 3
+#define PORTD4 4
+#define PORTD5 5
+#define PORTD6 6
+#define PORTD7 7
+
+/* last EEPROM address */
+#define E2END  0x3FF
+
+/* EICRA, EIMSK, EIFR */
+#define ISC00  0
+#define ISC01  1
+#define ISC10  2
+#define ISC11  3
+#define INT0   0
+#define INT1   1
+#define INTF0  0
+#define INTF1  1
+
+/* Timer 0 */
+#define WGM00  0
+#define WGM01  1
+#define CS00   0
+#define CS01   1
+#define CS02   2
+#define WGM02  3
+#define TOIE0  0
+#define TOV0   0
+
+/* Timer 1 */
+#define WGM10  0
+#define WGM11  1
+#define CS10   0
+#define CS11   1
+#define CS12   2
+#define WGM12  3
+#define WGM13  4
+#define TOIE1  0
+#define TOV1   0
+
+/* ADC */
+#define ADPS0  0
+#define ADPS1  1
+#define ADPS2  2
+#define ADIE   3
+#define ADIF   4
+#define ADATE  5
+#define ADSC   6
+#define ADEN   7
+#define MUX0   0
+#define ADLAR  5
+#define REFS0  6
+#define REFS1  7
+
+/* USART 0 */
+#define RXC0   7
+#define TXC0   6
+#define UDRE0  5
+#define RXCIE0 7
+#define TXCIE0 6
+#define UDRIE0 5
+#define RXEN0  4
+#define TXEN0  3
+
+#ifndef _BV
+#define _BV(bit) (1 << (bit))
+#endif
+
+#endif /* _AVRSIM_IO_H_ */
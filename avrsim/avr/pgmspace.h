@@ -0,0 +1,18 @@
+#ifndef _AVRSIM_PGMSPACE_H_
+#define _AVRSIM_PGMSPACE_H_
+
+#include <inttypes.h>
+
+/*
+  Host side stand-in for <avr/pgmspace.h>. Program memory is ordinary
+  constant data, read through a pointer.
+ */
+
+#define PROGMEM
+#define PSTR(s) (s)
+
+#define pgm_read_byte(address) (*(const uint8_t*)(address))
+#define pgm_read_word(address) (*(const uint16_t*)(address))
+#define pgm_read_dword(address) (*(const uint32_t*)(address))
+
+#endif /* _AVRSIM_PGMSPACE_H_ */
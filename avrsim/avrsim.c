@@ -0,0 +1,18 @@
+#include "avrsim.h"
+#include "avr/io.h"
+#include "avr/interrupt.h"
+
+DEVICE_STATE uint16_t sim_adc_input[8];
+
+/* channel of the conversion in progress */
+static DEVICE_STATE uint8_t adc_converting;
+
+void sim_adc_convert(void){
+  uint16_t value = sim_adc_input[adc_converting] & 0x3ff;
+  ADCL = value & 0xff;
+  ADCH = value >> 8;
+  // in free running mode the next conversion starts straight away, with
+  // the channel selected before the ISR gets to change it
+  adc_converting = ADMUX & 7;
+  ADC_vect();
+}
@@ -0,0 +1,26 @@
+#ifndef _AVRSIM_H_
+#define _AVRSIM_H_
+
+#include <inttypes.h>
+#include "avr/io.h"
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+/* analog input levels, 0-1023 */
+extern DEVICE_STATE uint16_t sim_adc_input[8];
+/* complete a free running conversion and call ADC_vect */
+void sim_adc_convert(void);
+
+/* queue bytes to be returned by serialRead() */
+void sim_serial_receive(const char* s);
+/* everything written with serialWrite() since the last sim_serial_clear() */
+const char* sim_serial_output(void);
+void sim_serial_clear(void);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif /* _AVRSIM_H_ */
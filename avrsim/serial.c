@@ -0,0 +1,111 @@
+/*
+  Host side implementation of the serial.h API.
+  Transmitted bytes are collected in a buffer which the tests can inspect,
+  and received bytes are queued with sim_serial_receive().
+ */
+
+#include "serial.h"
+#include "avrsim.h"
+
+#define SIM_SERIAL_BUFFER_SIZE 4096
+
+static DEVICE_STATE char tx_buffer[SIM_SERIAL_BUFFER_SIZE+1];
+static DEVICE_STATE int tx_length = 0;
+
+static DEVICE_STATE unsigned char rx_buffer[SIM_SERIAL_BUFFER_SIZE];
+static DEVICE_STATE int rx_head = 0;
+static DEVICE_STATE int rx_tail = 0;
+
+void beginSerial(long baud){
+  (void)baud;
+}
+
+void serialWrite(unsigned char c){
+  if(tx_length < SIM_SERIAL_BUFFER_SIZE)
+    tx_buffer[tx_length++] = c;
+}
+
+int serialAvailable(void){
+  return (SIM_SERIAL_BUFFER_SIZE + rx_head - rx_tail) % SIM_SERIAL_BUFFER_SIZE;
+}
+
+int serialRead(void){
+  if(rx_head == rx_tail)
+    return -1;
+  unsigned char c = rx_buffer[rx_tail];
+  rx_tail = (rx_tail + 1) % SIM_SERIAL_BUFFER_SIZE;
+  return c;
+}
+
+void serialFlush(void){
+  rx_head = rx_tail;
+}
+
+void sim_serial_receive(const char* s){
+  while(*s){
+    int i = (rx_head + 1) % SIM_SERIAL_BUFFER_SIZE;
+    if(i == rx_tail)
+      return;
+    rx_buffer[rx_head] = *s++;
+    rx_head = i;
+  }
+}
+
+const char* sim_serial_output(void){
+  tx_buffer[tx_length] = '\0';
+  return tx_buffer;
+}
+
+void sim_serial_clear(void){
+  tx_length = 0;
+}
+
+void printByte(unsigned char c){
+  serialWrite(c);
+}
+
+void printNewline(void){
+  printByte('\n');
+}
+
+void printString(const char *s){
+  while(*s)
+    printByte(*s++);
+}
+
+void printIntegerInBase(unsigned long n, unsigned long base){
+  unsigned char buf[8 * sizeof(long)];
+  unsigned long i = 0;
+  if(n == 0){
+    printByte('0');
+    return;
+  }
+  while(n > 0){
+    buf[i++] = n % base;
+    n /= base;
+  }
+  for(; i > 0; i--)
+    printByte(buf[i - 1] < 10 ?
+	      '0' + buf[i - 1] :
+	      'A' + buf[i - 1] - 10);
+}
+
+void printInteger(long n){
+  if(n < 0){
+    printByte('-');
+    n = -n;
+  }
+  printIntegerInBase(n, 10);
+}
+
+void printHex(unsigned long n){
+  printIntegerInBase(n, 16);
+}
+
+void printOctal(unsigned long n){
+  printIntegerInBase(n, 8);
+}
+
+void printBinary(unsigned long n){
+  printIntegerInBase(n, 2);
+}
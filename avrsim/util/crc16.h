@@ -0,0 +1,23 @@
+#ifndef _AVRSIM_CRC16_H_
+#define _AVRSIM_CRC16_H_
+
+#include <inttypes.h>
+
+/*
+  Host side stand-in for <util/crc16.h>, with the C equivalents given in
+  the avr-libc documentation of the optimised inline assembly.
+ */
+
+static inline uint8_t _crc8_ccitt_update(uint8_t crc, uint8_t data){
+  uint8_t i;
+  crc ^= data;
+  for(i=0; i<8; ++i){
+    if(crc & 0x80)
+      crc = (crc << 1) ^ 0x07;
+    else
+      crc <<= 1;
+  }
+  return crc;
+}
+
+#endif /* _AVRSIM_CRC16_H_ */
@@ -3,10 +3,17 @@
 #define ADC_OVERSAMPLING                4
 #define ADC_VALUE_RANGE                 (1024*ADC_OVERSAMPLING)
 #define CLOCKDELAY_DEADBAND_THRESHOLD  (ADC_VALUE_RANGE/32/4)
+/* the clock is lost when it has not risen for this many of its last periods */
+#define CLOCKDELAY_LOSS_PERIODS        4
 
 #define DIVIDE_ADC_CHANNEL              0
 #define DELAY_ADC_CHANNEL               1
 
+/* storage class of the device state, thread local in threaded host simulation */
+#ifndef DEVICE_STATE
+#define DEVICE_STATE
+#endif
+
 /*
   pin mappings
  */